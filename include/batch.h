@@ -0,0 +1,13 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "libtakuzu.h"
+
+bool batch_solve(FILE *fd, const tkz_corpus *corpus, const tkz_options *opts,
+                 int nb_threads);
+void run_workers(void *(*worker)(void *), void *arg, int nb_threads);
+
+#endif /* BATCH_H */
@@ -0,0 +1,12 @@
+#ifndef BULK_H
+#define BULK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "libtakuzu.h"
+
+bool bulk_generate(long nb_puzzles, int size, int percentage_fill, bool unique,
+                   const tkz_options *opts, int nb_threads, uint64_t seed);
+
+#endif /* BULK_H */
@@ -0,0 +1,10 @@
+#ifndef CDCL_H
+#define CDCL_H
+
+#include "grid.h"
+#include "libtakuzu.h"
+
+long grid_solver_cdcl(tkz_context *ctx, t_grid *grid, t_sink *sink,
+                      const t_mode mode);
+
+#endif /* CDCL_H */
@@ -0,0 +1,14 @@
+#ifndef CNF_H
+#define CNF_H
+
+#include <stdio.h>
+
+#include "grid.h"
+#include "libtakuzu.h"
+
+void cnf_write(const t_grid *grid, FILE *fd);
+
+long grid_solver_sat(tkz_context *ctx, t_grid *grid, t_sink *sink,
+                     const t_mode mode, const char *solver);
+
+#endif /* CNF_H */
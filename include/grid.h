@@ -5,7 +5,7 @@
 #include <stdint.h>
 #include <stdio.h>
 
-#include "takuzu.h"
+#include "libtakuzu.h"
 
 typedef struct {
   int row;
@@ -13,42 +13,92 @@ typedef struct {
   char choice;
 } choice_t;
 
-typedef enum { MODE_FIRST, MODE_ALL } t_mode;
-extern t_mode mode;
+// Growable list of the solutions found by the solver
+typedef struct {
+  t_grid **grids;  // Copies of the solved grids
+  int count;       // Number of solutions stored
+  int capacity;    // Number of slots allocated in grids
+} t_solutions;
+
+typedef struct {
+  t_solution_callback callback;  // NULL to only count the solutions
+  void *data;                    // Given back to callback
+  long count;                    // Number of solutions found so far
+  long limit;                    // Stop the search at that count (0: never)
+  long max_nodes;  // Stop the backtracking search after that many nodes
+                   // (0: never), the count is then a lower bound
+  long nodes;      // Nodes of the search visited so far (decisions of the
+                   // conflict-driven engine)
+} t_sink;
+
+// Binary grid records, see tkz_grid_write_bin
+#define BIN_MAGIC "TKZ"
+#define BIN_VERSION 1
+#define BIN_HEADER_SIZE 8
+
+size_t bin_record_size(const unsigned char *header);
+tkz_status bin_decode(tkz_context *ctx, t_grid *grid,
+                      const unsigned char *record);
 
-void grid_copy(t_grid *gs, t_grid *gd);
+void context_reset(tkz_context *ctx);
+void context_fail(tkz_context *ctx, tkz_status status, const char *format,
+                  ...);
+
+bool sink_done(const t_sink *sink, const t_mode mode);
+
+bool check_char(char c);
+void grid_allocate(t_grid *g, int size);
+void grid_free(t_grid *g);
+size_t grid_render(const t_grid *g, char *out, bool one_line);
+void grid_print(const t_grid *g, FILE *fd);
+void grid_copy(const t_grid *gs, t_grid *gd);
 void set_cell(int i, int j, t_grid *g, char v);
-char get_cell(int i, int j, t_grid *g);
+char get_cell(int i, int j, const t_grid *g);
+
+uint64_t line_mask(int size);
+
+bool trail_init(t_trail *t, int size);
+void trail_free(t_trail *t);
+int trail_mark(const t_grid *g);
+void trail_undo(t_grid *g, int mark);
 
 bool is_grid_full(t_grid *g);
 
 bool is_row_empty(int i, t_grid *g);
 bool is_col_empty(int j, t_grid *g);
+bool is_row_full(int i, t_grid *g);
+bool is_col_full(int j, t_grid *g);
 
 bool is_consistent(t_grid *g);
 bool is_valid(t_grid *g);
 
-choice_t grid_choice(t_grid *grid);
-void grid_choice_apply(t_grid *grid, const choice_t choice);
+choice_t grid_choice(tkz_context *ctx, t_grid *grid, t_branching policy,
+                     uint64_t rng[4]);
+void grid_choice_apply(tkz_context *ctx, t_grid *grid, const choice_t choice);
 void grid_choice_remove(t_grid *grid, const choice_t choice);
 void grid_choice_print(const choice_t choice, FILE *fd);
 
-void add_solution(t_grid *grid, t_grid **solutions, int *nb_solutions);
-void free_solutions(t_grid **solutions, int nb_solutions);
-
-bool grid_solver(t_grid *grid, const t_mode mode);
-int grid_solver_recursive(t_grid *grid, t_grid **solutions, int *nb_solutions,
-                          const t_mode mode);
+bool add_solution(const t_grid *grid, t_solutions *solutions);
+void free_solutions(t_solutions *solutions);
+void collect_solution(const t_grid *solution, void *data);
+void sink_emit(t_sink *sink, const t_grid *solution);
 
-bool apply_heuristic1(t_grid *g);
-bool sub_heuristic1_rows(t_grid *g);
-bool sub_heuristic1_cols(t_grid *g);
-bool apply_heuristic2(t_grid *g);
-bool sub_heuristic2_rows(t_grid *g);
-bool sub_heuristic2_cols(t_grid *g);
+long grid_solver(tkz_context *ctx, t_grid *grid, t_sink *sink,
+                 const t_mode mode);
+long grid_solver_trail(tkz_context *ctx, t_grid *grid, t_sink *sink,
+                       const t_mode mode);
+long grid_solver_symmetric(tkz_context *ctx, t_grid *grid, t_sink *sink,
+                           const t_mode mode);
+long grid_solver_recursive(tkz_context *ctx, t_grid *grid, t_sink *sink,
+                           const t_mode mode);
 
-void apply_heuristics(t_grid *g);
-void generate_grid(t_grid *g, int percentage_fill);
-t_grid *generate_unique_grid(t_grid *grid, int percentage_fill);
+bool propagate_row(tkz_context *ctx, t_grid *g, int i);
+bool propagate_col(tkz_context *ctx, t_grid *g, int j);
+bool apply_heuristics(tkz_context *ctx, t_grid *g);
+bool apply_lookahead(tkz_context *ctx, t_grid *g, int level);
+bool grid_propagate(tkz_context *ctx, t_grid *g);
+void generate_grid(tkz_context *ctx, t_grid *g, int percentage_fill);
+bool generate_unique_grid(tkz_context *ctx, t_grid *grid,
+                          int percentage_fill);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,170 @@
+#ifndef LIBTAKUZU_H
+#define LIBTAKUZU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Takuzu solver and generator library. Every call takes a tkz_context that
+// holds the options, the error and the log of the call: the library keeps no
+// global state of its own, several contexts can be used at the same time from
+// different threads. Nothing is printed (unless a log is given) and nothing
+// exits, errors are returned as a tkz_status.
+
+#define MIN_GRID_SIZE 4
+#define MAX_GRID_SIZE 64
+
+typedef enum { MODE_FIRST, MODE_ALL } t_mode;
+
+// How the solver picks the cell to branch on, see grid_choice
+typedef enum {
+  BRANCH_LINE,         // in the line with the fewest empty cells (default)
+  BRANCH_BALANCE,      // closest to the balance limit of its row or column
+  BRANCH_PROPAGATION,  // whose value forces the most cells
+  BRANCH_RANDOM,       // random empty cell and value (order and values of
+                       // the decisions of ENGINE_CDCL)
+} t_branching;
+
+// Search algorithm of the solver
+typedef enum {
+  ENGINE_BACKTRACK,  // chronological backtracking (default)
+  ENGINE_CDCL,       // clause learning and backjumping, see grid_solver_cdcl
+  ENGINE_SAT,        // external SAT solver, see grid_solver_sat
+} t_engine;
+
+// Undo log of the cells set in a grid: every entry packs the cell index
+// (i * MAX_GRID_SIZE + j) and the value it held before being set, so that
+// backtracking only has to roll the log back to a previous length
+typedef struct {
+  uint16_t *cells;  // Packed entries, see set_cell
+  int length;       // Number of entries in use
+  int capacity;     // Number of entries allocated
+} t_trail;
+
+// Number of slots of a t_line_set, a power of two at least twice the number
+// of lines so that probe sequences stay short
+#define LINE_SET_SIZE 128
+
+// Hash multiset of the full lines of one direction, keyed on the mask of
+// their ones (open addressing, linear probing)
+typedef struct {
+  uint64_t keys[LINE_SET_SIZE];   // Ones of a full line
+  uint8_t counts[LINE_SET_SIZE];  // Full lines with that key, 0: free slot
+} t_line_set;
+
+// Bitboard representation of a grid: every row and every column is stored as
+// a pair of masks, one for the cells holding '0' and one for the cells holding
+// '1'. A cell that is in neither mask is empty ('_').
+typedef struct {
+  int size;                         // Number of elements in a row
+  uint64_t rows[2][MAX_GRID_SIZE];  // rows[v][i] bit j is set if (i, j) == v
+  uint64_t cols[2][MAX_GRID_SIZE];  // cols[v][j] bit i is set if (i, j) == v
+  t_trail *trail;                   // Records every set_cell (NULL if unused)
+
+  // Incremental state maintained by set_cell and trail_undo, the number of
+  // zeros and ones of a line is the popcount of its masks
+  int empty_cells;      // Number of '_' in the grid
+  uint64_t dirty_rows;  // Rows modified since is_consistent last succeeded
+  uint64_t dirty_cols;  // Columns modified since is_consistent last succeeded
+  uint64_t queue_rows;  // Rows set_cell modified, waiting for apply_heuristics
+  uint64_t queue_cols;  // Columns set_cell modified, same as above
+
+  t_line_set full_rows;  // Full rows, maintained by set_cell and trail_undo
+  t_line_set full_cols;  // Full columns, same as above
+  int duplicates;        // Full lines identical to another one
+} t_grid;
+
+// Outcome of a library call, tkz_strerror describes it
+typedef enum {
+  TKZ_OK,
+  TKZ_ERROR_SIZE,          // not one of the sizes 4, 8, 16, 32, 64
+  TKZ_ERROR_CHARACTER,     // a cell is not '0', '1' or '_'
+  TKZ_ERROR_SHAPE,         // rows of different lengths, too many rows
+  TKZ_ERROR_EMPTY,         // no grid to read
+  TKZ_ERROR_INCONSISTENT,  // the cells given already break a rule
+  TKZ_ERROR_ARGUMENT,      // invalid option or cell coordinates
+  TKZ_ERROR_MEMORY,        // an allocation failed
+  TKZ_ERROR_IO,            // a read or a write failed
+  TKZ_ERROR_SAT_SOLVER,    // the external SAT solver is missing or failed
+  TKZ_ERROR_THREAD,        // a solver thread could not be started
+} tkz_status;
+
+// Receives every solution found by the solver as soon as it is found. The
+// grid given is the one the solver works on, it is only valid during the call.
+typedef void (*t_solution_callback)(const t_grid *solution, void *data);
+
+// Options of tkz_solve and tkz_generate, tkz_options_init sets the defaults
+typedef struct {
+  t_engine engine;         // search algorithm
+  t_branching branching;   // branching policy of ENGINE_BACKTRACK
+  t_mode mode;             // first solution only, or all of them
+  long limit;              // stop after that many solutions (0: no limit)
+  int threads;             // solver threads of ENGINE_BACKTRACK
+  int lookahead;           // probing level before branching (0, 1 or 2)
+  bool symmetry;           // without a callback, count one solution per orbit
+  const char *sat_solver;  // SAT solver binary of ENGINE_SAT (NULL: search)
+} tkz_options;
+
+// File of grids (text or binary, as read by tkz_grid_read) mapped in memory,
+// with the offset of every grid so that any of them is parsed without reading
+// the ones before it. Grids are parsed straight from the mapped bytes.
+typedef struct {
+  const char *data;         // Content of the file
+  size_t length;            // Bytes of the file
+  const uint64_t *offsets;  // Offset in data of the start of every grid
+  long nb_grids;            // Number of offsets
+  void *index_map;          // Mapped index file, NULL if offsets was built
+  size_t index_length;      // Bytes of the index file
+} tkz_corpus;
+
+// Bytes of the largest grid rendered by tkz_grid_format, and encoded by
+// tkz_grid_encode_bin
+#define TKZ_TEXT_SIZE (MAX_GRID_SIZE * (MAX_GRID_SIZE + 1))
+#define TKZ_RECORD_SIZE (8 + 2 * MAX_GRID_SIZE * 8)
+
+#define TKZ_MESSAGE_SIZE 256
+
+// State of the calls made with it. A context must not be used by two calls
+// at the same time, but the solver threads of a call share it.
+typedef struct {
+  tkz_options options;              // Options of the last call
+  FILE *log;                        // Trace of the solver, NULL: quiet
+  tkz_status status;                // First error of the last call
+  char message[TKZ_MESSAGE_SIZE];   // Details of that error
+  long nb_solutions;                // Solutions found by the last tkz_solve
+  long nb_nodes;                    // Search nodes (decisions) it visited
+  uint64_t rng[4];                  // Random generator, see tkz_context_seed
+} tkz_context;
+
+void tkz_options_init(tkz_options *opts);
+void tkz_context_init(tkz_context *ctx);
+void tkz_context_seed(tkz_context *ctx, uint64_t seed, uint64_t stream);
+const char *tkz_strerror(tkz_status status);
+
+bool tkz_valid_size(int size);
+tkz_status tkz_grid_init(tkz_context *ctx, t_grid *grid, int size);
+tkz_status tkz_grid_set(tkz_context *ctx, t_grid *grid, int i, int j, char v);
+char tkz_grid_get(const t_grid *grid, int i, int j);
+tkz_status tkz_grid_read(tkz_context *ctx, t_grid *grid, FILE *fd);
+void tkz_grid_write(const t_grid *grid, FILE *fd);
+void tkz_grid_write_bin(const t_grid *grid, FILE *fd);
+size_t tkz_grid_format(const t_grid *grid, char *text, bool one_line);
+size_t tkz_grid_encode_bin(const t_grid *grid, unsigned char *record);
+tkz_status tkz_grid_parse(tkz_context *ctx, t_grid *grid, const char *text,
+                          size_t length);
+
+tkz_status tkz_corpus_open(tkz_context *ctx, tkz_corpus *corpus,
+                           const char *filename, const char *index_filename);
+tkz_status tkz_corpus_grid(tkz_context *ctx, const tkz_corpus *corpus, long n,
+                           t_grid *grid);
+void tkz_corpus_close(tkz_corpus *corpus);
+
+tkz_status tkz_solve(tkz_context *ctx, const t_grid *grid,
+                     const tkz_options *opts, t_solution_callback callback,
+                     void *data);
+tkz_status tkz_generate(tkz_context *ctx, t_grid *grid, int size,
+                        int percentage_fill, bool unique,
+                        const tkz_options *opts);
+tkz_status tkz_export_cnf(tkz_context *ctx, const t_grid *grid, FILE *fd);
+
+#endif /* LIBTAKUZU_H */
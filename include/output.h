@@ -0,0 +1,30 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "libtakuzu.h"
+
+// Bytes of solutions a printer gathers before writing them
+#define PRINT_BUFFER_SIZE (1 << 20)
+
+// Where print_solution writes, and the number of solutions printed there.
+// Solutions are rendered into buffer and written a whole buffer at a time.
+typedef struct {
+  FILE *fd;
+  long printed;
+  char *buffer;   // Solutions not written yet, NULL: written one by one
+  size_t length;  // Bytes used in buffer
+  int error;      // errno of the first write that failed, 0: none
+} t_printer;
+
+void printer_init(t_printer *printer, FILE *fd, bool buffered);
+void printer_flush(t_printer *printer);
+void printer_free(t_printer *printer);
+
+void write_grid(const t_grid *grid, FILE *fd);
+void print_solution(const t_grid *solution, void *data);
+
+#endif /* OUTPUT_H */
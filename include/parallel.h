@@ -0,0 +1,10 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "grid.h"
+#include "libtakuzu.h"
+
+long grid_solver_parallel(tkz_context *ctx, t_grid *grid, t_sink *sink,
+                          const t_mode mode, int nb_threads);
+
+#endif /* PARALLEL_H */
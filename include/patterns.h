@@ -0,0 +1,31 @@
+#ifndef PATTERNS_H
+#define PATTERNS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Largest line size for which the valid lines are enumerated
+#define PATTERNS_MAX_SIZE 16
+// Number of words of a domain bitset for PATTERNS_MAX_SIZE (1484 lines)
+#define PATTERNS_MAX_WORDS 24
+
+// Every valid line (balanced, no three identical cells in a row) of a given
+// size. A domain is a bitset over these lines, bit p standing for lines[p].
+typedef struct {
+  int size;
+  int count;              // Number of valid lines
+  int words;              // Number of uint64_t in a domain
+  uint64_t *lines;        // Mask of the ones of every valid line
+  int *index;             // Position in lines of a ones mask, -1 if invalid
+  uint64_t *has[2];       // has[v][k * words]: domain of the lines with v at k
+} t_patterns;
+
+const t_patterns *patterns_get(int size);
+
+void patterns_domain(const t_patterns *p, uint64_t zeros, uint64_t ones,
+                     uint64_t *domain);
+void patterns_exclude(const t_patterns *p, uint64_t line, uint64_t *domain);
+bool patterns_forced(const t_patterns *p, const uint64_t *domain,
+                     uint64_t *to_zero, uint64_t *to_one);
+
+#endif /* PATTERNS_H */
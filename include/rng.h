@@ -0,0 +1,12 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+#include "libtakuzu.h"
+
+void rng_seed(uint64_t state[4], uint64_t seed, uint64_t stream);
+uint64_t rng_next(uint64_t state[4]);
+uint32_t rng_below(uint64_t state[4], uint32_t bound);
+
+#endif /* RNG_H */
@@ -0,0 +1,26 @@
+#ifndef SYMMETRY_H
+#define SYMMETRY_H
+
+#include <stdbool.h>
+
+#include "libtakuzu.h"
+
+// A symmetry of the rules combines the 8 symmetries of the square and the
+// exchange of '0' and '1'. Row i of the image is a line of the grid:
+#define SYM_USE_COLS 1  // column instead of row
+#define SYM_FLIP 2      // index size - 1 - i instead of i
+#define SYM_REVERSE 4   // read backwards
+#define SYM_SWAP 8      // with '0' and '1' exchanged
+#define SYM_GROUP_SIZE 16
+
+// Subgroup of the symmetries that leave a grid unchanged
+typedef struct {
+  int count;                      // Number of symmetries, identity included
+  int elements[SYM_GROUP_SIZE];   // Combinations of the SYM_* flags
+} t_symmetries;
+
+void symmetries_detect(const t_grid *g, t_symmetries *h);
+bool symmetries_may_lead(const t_grid *g, const t_symmetries *h);
+long symmetries_weight(const t_grid *g, const t_symmetries *h);
+
+#endif /* SYMMETRY_H */
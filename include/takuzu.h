@@ -5,40 +5,57 @@
 #include <stdint.h>
 #include <stdio.h>
 
-#define MIN_GRID_SIZE 4
-#define MAX_GRID_SIZE 64
+#include "libtakuzu.h"
 
 // NONE is the default mode to better handle incompatible options in parse_args
-typedef enum { NONE, SOLVER, GENERATOR } modes;
+typedef enum { NONE, SOLVER, GENERATOR, CONVERTER } modes;
 
-typedef struct {
-  int size;     // Number of elements in a row
-  char **grid;  // Pointer to the grid
-} t_grid;
+// How the grids are written: as text, as text with a grid per line (only
+// written, not read back), or as binary records (see tkz_grid_write_bin)
+typedef enum { FORMAT_TEXT, FORMAT_LINE, FORMAT_BIN } t_format;
 
 typedef struct {
   modes mode;         // solver or generator
   FILE *output_file;  // output file
+  FILE *info_file;    // messages, stderr when the output holds binary grids
+  t_format format;    // format of the grids written
 
   t_grid *grid;         // grid to solve
   int grid_size;        // size of the grid
   int percentage_fill;  // percentage of the grid to fill (GENERATOR mode)
-
+  long nb_puzzles;      // distinct puzzles to generate, 0: a single grid
+  uint64_t seed;        // seed of the random generator (GENERATOR mode)
+  bool seeded;          // seed given, otherwise taken from the clock
+
+  t_engine engine;        // search algorithm (SOLVER mode)
+  const char *sat_solver;  // SAT solver binary of ENGINE_SAT (NULL: search)
+  const char *cnf_file;    // export the grid as CNF instead (SOLVER mode)
+  const char *index_file;  // grid offsets of the input file (SOLVER mode)
+  long grid_number;        // grid of the input file to solve, 0: the first
+  t_branching branching;  // branching policy (SOLVER mode)
+  int threads;            // number of solver or generator threads
+  int lookahead;          // probing level before branching (SOLVER mode)
+
+  bool batch;    // solve every grid of the input file (SOLVER mode)
   bool all;      // all solutions
+  bool count;    // only count the solutions
+  bool symmetry;  // count one solution per orbit of the grid's symmetries
+  long limit;    // stop after that many solutions (0: no limit)
   bool unique;   // unique solution
   bool verbose;  // verbose output
+  bool stats;    // print the time, nodes and memory of the run to stderr
 
 } software_info;
 
 extern software_info sw;
+extern t_mode mode;
 
 void usage();
 void parse_args(int argc, char **argv);
 
-void grid_allocate(t_grid *g, int size);
-void grid_free(t_grid *g);
-void grid_print(const t_grid *g, FILE *fd);
 void file_parser(t_grid *grid, char *filename);
-bool check_char(char c);
+FILE *open_input(const char *filename);
+void print_count(FILE *fd, long nb_solutions);
+void exit_on_error(const tkz_context *ctx);
 
 #endif /* TAKUZU_H */
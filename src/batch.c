@@ -0,0 +1,189 @@
+#include "batch.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libtakuzu.h"
+#include "output.h"
+#include "takuzu.h"
+
+// Grids read, solved and written at a time. Bounds the memory used whatever
+// the size of the input, while giving the threads enough grids to share.
+#define BATCH_CHUNK 1024
+
+// A grid of the input and what is printed about it
+typedef struct {
+  t_grid grid;
+  tkz_status status;               // Of reading the grid, then of solving it
+  char message[TKZ_MESSAGE_SIZE];  // Details of status
+  long nb_solutions;
+  char *output;   // Solutions and count, written to an in-memory stream
+  size_t length;  // Bytes in output
+} t_batch_entry;
+
+// Where the grids come from: a corpus mapped in memory, or a stream (the
+// standard input, or a file that can't be mapped) read grid by grid
+typedef struct {
+  FILE *fd;                  // NULL if the grids come from corpus
+  const tkz_corpus *corpus;
+  long next;                 // Next grid of corpus
+} t_batch_input;
+
+typedef struct {
+  t_batch_entry *entries;
+  int count;
+  atomic_int next;  // Next entry to solve
+  long first;       // Number of entries[0] in the input, from 0
+  const tkz_options *opts;
+} t_batch_chunk;
+
+// Solves a grid that has been read without error. Its solutions are printed
+// to a buffer so that the threads don't mix their output.
+static void solve_entry(t_batch_entry *e, long number,
+                        const tkz_options *opts) {
+  FILE *out = open_memstream(&e->output, &e->length);
+  if (out == NULL) {
+    e->status = TKZ_ERROR_MEMORY;
+    snprintf(e->message, sizeof(e->message), "%s",
+             tkz_strerror(TKZ_ERROR_MEMORY));
+    return;
+  }
+
+  tkz_context ctx;
+  tkz_context_init(&ctx);
+  // a random search of a grid doesn't depend on the thread solving it
+  tkz_context_seed(&ctx, sw.seed, number);
+  ctx.log = sw.verbose && sw.format == FORMAT_TEXT ? out : NULL;
+  // out is already a buffer
+  t_printer printer;
+  printer_init(&printer, out, false);
+  tkz_solve(&ctx, &e->grid, opts, sw.count ? NULL : print_solution, &printer);
+  printer_free(&printer);
+  // binary solutions are written alone
+  if (ctx.status == TKZ_OK && sw.format == FORMAT_TEXT) {
+    print_count(out, ctx.nb_solutions);
+  }
+  fclose(out);
+
+  e->status = ctx.status;
+  e->nb_solutions = ctx.nb_solutions;
+  memcpy(e->message, ctx.message, sizeof(e->message));
+}
+
+// Reads the next grid of the input into e, returns false at the end of it
+static bool read_entry(t_batch_input *input, t_batch_entry *e) {
+  tkz_context ctx;
+  tkz_context_init(&ctx);
+  if (input->fd == NULL) {
+    if (input->next == input->corpus->nb_grids) {
+      return false;
+    }
+    tkz_corpus_grid(&ctx, input->corpus, input->next, &e->grid);
+    input->next++;
+  } else if (tkz_grid_read(&ctx, &e->grid, input->fd) == TKZ_ERROR_EMPTY) {
+    return false;
+  }
+  e->status = ctx.status;
+  memcpy(e->message, ctx.message, sizeof(e->message));
+  e->nb_solutions = 0;
+  e->output = NULL;
+  e->length = 0;
+  return true;
+}
+
+static void *batch_worker(void *arg) {
+  t_batch_chunk *chunk = arg;
+  int k;
+  while ((k = atomic_fetch_add(&chunk->next, 1)) < chunk->count) {
+    if (chunk->entries[k].status == TKZ_OK) {
+      solve_entry(&chunk->entries[k], chunk->first + k, chunk->opts);
+    }
+  }
+  return NULL;
+}
+
+// Runs worker(arg) on nb_threads threads (the calling thread being one of
+// them) and waits for all of them. The workers share the work through arg,
+// whatever threads could not be started, the calling thread does what is left.
+void run_workers(void *(*worker)(void *), void *arg, int nb_threads) {
+  pthread_t *threads = malloc((nb_threads - 1) * sizeof(pthread_t));
+  int started = 0;
+  while (threads != NULL && started < nb_threads - 1 &&
+         pthread_create(&threads[started], NULL, worker, arg) == 0) {
+    started++;
+  }
+  worker(arg);
+  for (int k = 0; k < started; k++) {
+    pthread_join(threads[k], NULL);
+  }
+  free(threads);
+}
+
+// Reads every grid of fd, or of corpus if fd is NULL, solves them (nb_threads
+// at a time) with opts and writes for each one, in input order, a status line
+// followed by what the single grid mode would print. Returns false if a grid
+// could not be read, had no solution or failed to be solved.
+bool batch_solve(FILE *fd, const tkz_corpus *corpus, const tkz_options *opts,
+                 int nb_threads) {
+  t_batch_input input = {fd, corpus, 0};
+  t_batch_chunk chunk;
+  chunk.entries = malloc(BATCH_CHUNK * sizeof(t_batch_entry));
+  chunk.opts = opts;
+  if (chunk.entries == NULL) {
+    fprintf(stderr, "ERROR -> could not allocate the batch\n");
+    exit(EXIT_FAILURE);
+  }
+
+  long nb_grids = 0;
+  long nb_solved = 0;
+  long nb_errors = 0;
+  bool end = false;
+  while (!end) {
+    // Read a chunk of grids, a grid that can't be read is only reported
+    chunk.count = 0;
+    while (chunk.count < BATCH_CHUNK) {
+      if (!read_entry(&input, &chunk.entries[chunk.count])) {
+        end = true;
+        break;
+      }
+      chunk.count++;
+    }
+
+    atomic_init(&chunk.next, 0);
+    chunk.first = nb_grids;
+    run_workers(batch_worker, &chunk, nb_threads);
+
+    for (int k = 0; k < chunk.count; k++) {
+      t_batch_entry *e = &chunk.entries[k];
+      nb_grids++;
+      if (e->status != TKZ_OK) {
+        nb_errors++;
+        fprintf(sw.info_file, "Grid %ld: error, %s\n", nb_grids,
+                e->message[0] != '\0' ? e->message : tkz_strerror(e->status));
+      } else if (e->nb_solutions > 0) {
+        nb_solved++;
+        fprintf(sw.info_file, "Grid %ld: solved\n", nb_grids);
+      } else {
+        fprintf(sw.info_file, "Grid %ld: no solution\n", nb_grids);
+      }
+      if (e->output != NULL) {
+        fwrite(e->output, 1, e->length, sw.output_file);
+        free(e->output);
+      }
+    }
+  }
+  free(chunk.entries);
+
+  if (nb_grids == 0) {
+    fprintf(stderr, "ERROR -> empty file!\n");
+    return false;
+  }
+  fprintf(sw.info_file,
+          "Grids: %ld, solved: %ld, without solution: %ld, errors: %ld\n",
+          nb_grids, nb_solved, nb_grids - nb_solved - nb_errors, nb_errors);
+  return nb_solved == nb_grids;
+}
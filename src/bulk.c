@@ -0,0 +1,182 @@
+#include "bulk.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "libtakuzu.h"
+#include "output.h"
+#include "takuzu.h"
+
+// Puzzles generated at a time. Bounds the memory used whatever the number of
+// puzzles asked, while giving the threads enough attempts to share.
+#define BULK_CHUNK 256
+
+// An attempt at a puzzle: attempt k of a run generates with the random stream
+// k of the seed, so the puzzles don't depend on which thread made them
+typedef struct {
+  t_grid grid;
+  tkz_status status;               // Of the generation
+  char message[TKZ_MESSAGE_SIZE];  // Details of status
+} t_bulk_entry;
+
+typedef struct {
+  t_bulk_entry *entries;
+  int count;
+  long first;       // Attempt number of entries[0]
+  atomic_int next;  // Next entry to generate
+  int size;
+  int percentage_fill;
+  bool unique;
+  uint64_t seed;
+  const tkz_options *opts;
+} t_bulk_chunk;
+
+// Hashes of the puzzles written, to skip the ones generated twice (open
+// addressing, linear probing, 0: free slot)
+typedef struct {
+  uint64_t *keys;
+  size_t capacity;  // A power of two
+  size_t count;
+} t_hash_set;
+
+// Hash of a generated puzzle, never 0 (a free slot): the 0 and 1 masks of
+// every row go through splitmix64 steps chained to the previous ones
+static uint64_t grid_hash(const t_grid *grid, int size) {
+  uint64_t h = (uint64_t)size;
+  for (int i = 0; i < size; i++) {
+    for (int v = 0; v < 2; v++) {
+      h ^= grid->rows[v][i] + UINT64_C(0x9E3779B97F4A7C15);
+      h = (h ^ (h >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+      h = (h ^ (h >> 27)) * UINT64_C(0x94D049BB133111EB);
+      h ^= h >> 31;
+    }
+  }
+  return h != 0 ? h : 1;
+}
+
+static void *bulk_worker(void *arg) {
+  t_bulk_chunk *chunk = arg;
+  int k;
+  while ((k = atomic_fetch_add(&chunk->next, 1)) < chunk->count) {
+    t_bulk_entry *e = &chunk->entries[k];
+    tkz_context ctx;
+    tkz_context_init(&ctx);
+    tkz_context_seed(&ctx, chunk->seed, chunk->first + k);
+    tkz_generate(&ctx, &e->grid, chunk->size, chunk->percentage_fill,
+                 chunk->unique, chunk->opts);
+    e->status = ctx.status;
+    memcpy(e->message, ctx.message, sizeof(e->message));
+  }
+  return NULL;
+}
+
+// Adds key (not 0) to set, returns false if it was already there
+static bool hash_set_add(t_hash_set *set, uint64_t key) {
+  // at most half full, so that probe sequences stay short
+  if (2 * (set->count + 1) > set->capacity) {
+    size_t capacity = set->capacity == 0 ? 1024 : 2 * set->capacity;
+    uint64_t *keys = calloc(capacity, sizeof(uint64_t));
+    if (keys == NULL) {
+      fprintf(stderr, "ERROR -> could not allocate the puzzle hashes\n");
+      exit(EXIT_FAILURE);
+    }
+    for (size_t k = 0; k < set->capacity; k++) {
+      if (set->keys[k] != 0) {
+        size_t slot = set->keys[k] & (capacity - 1);
+        while (keys[slot] != 0) {
+          slot = (slot + 1) & (capacity - 1);
+        }
+        keys[slot] = set->keys[k];
+      }
+    }
+    free(set->keys);
+    set->keys = keys;
+    set->capacity = capacity;
+  }
+
+  size_t slot = key & (set->capacity - 1);
+  while (set->keys[slot] != 0) {
+    if (set->keys[slot] == key) {
+      return false;
+    }
+    slot = (slot + 1) & (set->capacity - 1);
+  }
+  set->keys[slot] = key;
+  set->count++;
+  return true;
+}
+
+// Generates nb_puzzles distinct puzzles (nb_threads at a time) and writes them
+// to the output as they come, in the order of the attempts, so that the same
+// seed gives the same puzzles whatever the number of threads. Text puzzles are
+// separated by blank lines and can be read back with --batch. Returns false if
+// a generation failed or if a whole chunk of attempts gave no new puzzle (the
+// size has too few of them).
+bool bulk_generate(long nb_puzzles, int size, int percentage_fill, bool unique,
+                   const tkz_options *opts, int nb_threads, uint64_t seed) {
+  t_bulk_chunk chunk;
+  chunk.entries = malloc(BULK_CHUNK * sizeof(t_bulk_entry));
+  if (chunk.entries == NULL) {
+    fprintf(stderr, "ERROR -> could not allocate the puzzles\n");
+    exit(EXIT_FAILURE);
+  }
+  chunk.first = 0;
+  chunk.size = size;
+  chunk.percentage_fill = percentage_fill;
+  chunk.unique = unique;
+  chunk.seed = seed;
+  chunk.opts = opts;
+
+  t_hash_set written = {NULL, 0, 0};
+  long nb_written = 0;
+  long nb_duplicates = 0;
+  bool failed = false;
+  while (nb_written < nb_puzzles && !failed) {
+    // no more attempts than puzzles missing, unless duplicates showed up
+    long missing = nb_puzzles - nb_written;
+    chunk.count = nb_duplicates == 0 && missing < BULK_CHUNK ? (int)missing
+                                                              : BULK_CHUNK;
+    atomic_init(&chunk.next, 0);
+    run_workers(bulk_worker, &chunk, nb_threads);
+
+    long nb_new = 0;
+    for (int k = 0; k < chunk.count && nb_written < nb_puzzles; k++) {
+      t_bulk_entry *e = &chunk.entries[k];
+      if (e->status != TKZ_OK) {
+        fprintf(stderr, "ERROR -> %s\n",
+                e->message[0] != '\0' ? e->message : tkz_strerror(e->status));
+        failed = true;
+        break;
+      }
+      if (!hash_set_add(&written, grid_hash(&e->grid, size))) {
+        nb_duplicates++;
+        continue;
+      }
+      if (nb_written > 0 && sw.format == FORMAT_TEXT) {
+        fputc('\n', sw.output_file);
+      }
+      write_grid(&e->grid, sw.output_file);
+      nb_written++;
+      nb_new++;
+    }
+    chunk.first += chunk.count;
+
+    if (!failed && nb_new == 0) {
+      fprintf(stderr, "ERROR -> only %ld distinct puzzles found!\n",
+              nb_written);
+      failed = true;
+    }
+  }
+  free(chunk.entries);
+  free(written.keys);
+
+  // a '#' line ends a grid, the bank stays readable by --batch
+  fprintf(sw.info_file, "%sPuzzles: %ld, duplicates skipped: %ld\n",
+          sw.format == FORMAT_TEXT ? "\n# " : "", nb_written, nb_duplicates);
+  return !failed;
+}
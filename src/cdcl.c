@@ -0,0 +1,701 @@
+#include "cdcl.h"
+
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "grid.h"
+#include "libtakuzu.h"
+#include "rng.h"
+
+// Conflict-driven search: every cell (i, j) is a boolean variable i * size + j
+// (true for '1'), a literal is 2 * var for "the cell holds 1" and
+// 2 * var + 1 for "the cell holds 0". The rule of at most two identical cells
+// in a row is encoded as clauses, balance and unique lines are propagators
+// that explain their deductions on demand during conflict analysis.
+
+#define LIT(var, value) (2 * (var) + ((value) ? 0 : 1))
+#define LIT_VAR(lit) ((lit) >> 1)
+#define LIT_NOT(lit) ((lit) ^ 1)
+
+#define UNASSIGNED -1
+
+// Conflicts before the first restart, multiplied by the Luby sequence
+#define RESTART_BASE 100
+// Activity decay of the variables after every conflict
+#define VAR_DECAY 0.95
+
+typedef enum {
+  REASON_DECISION,  // decision, or cell given by the grid
+  REASON_CLAUSE,    // unit clause, data is the clause index
+  REASON_BALANCE,   // line with half of its cells at the other value
+  REASON_UNIQUE,    // last cell of a line that would repeat a full line
+} t_reason_kind;
+
+typedef struct {
+  int size;
+  bool learnt;  // learnt clauses may be deleted, the others are kept
+  int lits[];   // lits[0] and lits[1] are watched
+} t_clause;
+
+typedef struct {
+  int *data;
+  int size;
+  int capacity;
+} t_vec;
+
+typedef struct {
+  int size;
+  int nb_vars;
+  int8_t *value;        // value of a variable (0, 1) or UNASSIGNED
+  int *level;           // decision level of a variable
+  int *trail_pos;       // position of a variable in the trail
+  int8_t *reason_kind;  // t_reason_kind of a variable
+  int *reason_data;     // clause index, or axis * MAX_GRID_SIZE + line
+  int8_t *phase;        // last value of a variable, tried first
+  double *activity;     // VSIDS score of a variable
+  double bump;          // current activity increment
+  int8_t *seen;         // scratch flags of conflict analysis
+
+  int *trail;      // assigned literals in order
+  int trail_size;  // number of assigned literals
+  int qhead;       // next literal of the trail to propagate
+  t_vec levels;    // trail size at the start of every decision level
+
+  t_clause **clauses;  // NULL once deleted
+  int nb_clauses;
+  int clauses_capacity;
+  int nb_learnts;
+  int max_learnts;
+  t_vec *watches;  // watches[lit]: clauses to visit when lit becomes false
+
+  // lines[axis][v][k]: cells of row (axis 0) or column (axis 1) k holding v
+  uint64_t lines[2][2][MAX_GRID_SIZE];
+
+  t_vec conflict;  // literals of the last conflict, all false
+  t_vec reason;    // explanation built by explain
+  t_vec learnt;    // clause built by analyze
+  long nb_conflicts;
+
+  jmp_buf out_of_memory;  // where an allocation failure leaves the search
+} t_cdcl;
+
+static void *checked_malloc(t_cdcl *s, size_t size) {
+  void *p = malloc(size);
+  if (p == NULL) {
+    longjmp(s->out_of_memory, 1);
+  }
+  return p;
+}
+
+static void *checked_calloc(t_cdcl *s, size_t count, size_t size) {
+  void *p = calloc(count, size);
+  if (p == NULL) {
+    longjmp(s->out_of_memory, 1);
+  }
+  return p;
+}
+
+static void vec_push(t_cdcl *s, t_vec *v, int x) {
+  if (v->size == v->capacity) {
+    int capacity = v->capacity ? 2 * v->capacity : 8;
+    int *data = realloc(v->data, capacity * sizeof(int));
+    if (data == NULL) {
+      longjmp(s->out_of_memory, 1);
+    }
+    v->data = data;
+    v->capacity = capacity;
+  }
+  v->data[v->size++] = x;
+}
+
+// 1 if the literal is true, 0 if false, UNASSIGNED otherwise
+static int lit_value(const t_cdcl *s, int lit) {
+  int8_t v = s->value[LIT_VAR(lit)];
+  return v == UNASSIGNED ? UNASSIGNED : v ^ (lit & 1);
+}
+
+static int decision_level(const t_cdcl *s) { return s->levels.size; }
+
+static void assign(t_cdcl *s, int lit, t_reason_kind kind, int data) {
+  int var = LIT_VAR(lit);
+  int v = !(lit & 1);
+  int i = var / s->size;
+  int j = var % s->size;
+  s->value[var] = v;
+  s->level[var] = decision_level(s);
+  s->trail_pos[var] = s->trail_size;
+  s->reason_kind[var] = kind;
+  s->reason_data[var] = data;
+  s->lines[0][v][i] |= UINT64_C(1) << j;
+  s->lines[1][v][j] |= UINT64_C(1) << i;
+  s->trail[s->trail_size++] = lit;
+}
+
+static void backtrack(t_cdcl *s, int level) {
+  if (decision_level(s) <= level) {
+    return;
+  }
+  int start = s->levels.data[level];
+  for (int k = s->trail_size - 1; k >= start; k--) {
+    int var = LIT_VAR(s->trail[k]);
+    int v = s->value[var];
+    int i = var / s->size;
+    int j = var % s->size;
+    s->lines[0][v][i] &= ~(UINT64_C(1) << j);
+    s->lines[1][v][j] &= ~(UINT64_C(1) << i);
+    s->phase[var] = v;
+    s->value[var] = UNASSIGNED;
+  }
+  s->trail_size = start;
+  s->qhead = start;
+  s->levels.size = level;
+}
+
+static int add_clause(t_cdcl *s, const int *lits, int size, bool learnt) {
+  if (s->nb_clauses == s->clauses_capacity) {
+    t_clause **clauses =
+        realloc(s->clauses, 2 * s->clauses_capacity * sizeof(t_clause *));
+    if (clauses == NULL) {
+      longjmp(s->out_of_memory, 1);
+    }
+    s->clauses = clauses;
+    s->clauses_capacity *= 2;
+  }
+  t_clause *c = checked_malloc(s, sizeof(t_clause) + size * sizeof(int));
+  c->size = size;
+  c->learnt = learnt;
+  memcpy(c->lits, lits, size * sizeof(int));
+  int index = s->nb_clauses++;
+  s->clauses[index] = c;
+  vec_push(s, &s->watches[lits[0]], index);
+  vec_push(s, &s->watches[lits[1]], index);
+  s->nb_learnts += learnt;
+  return index;
+}
+
+// Literal of the cell at position k of a line, for the value it holds
+static int line_lit(const t_cdcl *s, int axis, int line, int k) {
+  int var = axis == 0 ? line * s->size + k : k * s->size + line;
+  return LIT(var, s->value[var]);
+}
+
+static int line_pos(const t_cdcl *s, int axis, int var) {
+  return axis == 0 ? var % s->size : var / s->size;
+}
+
+static int line_index(const t_cdcl *s, int axis, int var) {
+  return axis == 0 ? var / s->size : var % s->size;
+}
+
+// Clause that forced `var`, the literal of var first and every other literal
+// false. Balance and unique-line deductions are only rebuilt here, when the
+// conflict analysis needs them.
+static const t_vec *explain(t_cdcl *s, int var) {
+  t_vec *r = &s->reason;
+  r->size = 0;
+  int data = s->reason_data[var];
+  if (s->reason_kind[var] == REASON_CLAUSE) {
+    t_clause *c = s->clauses[data];
+    for (int k = 0; k < c->size; k++) {
+      vec_push(s, r, c->lits[k]);
+    }
+    return r;
+  }
+
+  vec_push(s, r, LIT(var, s->value[var]));
+  int axis = data / MAX_GRID_SIZE;
+  int line = line_index(s, axis, var);
+  if (s->reason_kind[var] == REASON_BALANCE) {
+    // the cells of the line at the other value set before var
+    uint64_t cells = s->lines[axis][!s->value[var]][line];
+    for (; cells; cells &= cells - 1) {
+      int lit = line_lit(s, axis, line, __builtin_ctzll(cells));
+      if (s->trail_pos[LIT_VAR(lit)] < s->trail_pos[var]) {
+        vec_push(s, r, LIT_NOT(lit));
+      }
+    }
+  } else {
+    // the full line and the rest of the line of var
+    int other = data % MAX_GRID_SIZE;
+    int pos = line_pos(s, axis, var);
+    for (int k = 0; k < s->size; k++) {
+      vec_push(s, r, LIT_NOT(line_lit(s, axis, other, k)));
+      if (k != pos) {
+        vec_push(s, r, LIT_NOT(line_lit(s, axis, line, k)));
+      }
+    }
+  }
+  return r;
+}
+
+static bool propagate_clauses(t_cdcl *s, int lit) {
+  int false_lit = LIT_NOT(lit);
+  t_vec *ws = &s->watches[false_lit];
+  int i = 0;
+  int j = 0;
+  while (i < ws->size) {
+    int index = ws->data[i++];
+    t_clause *c = s->clauses[index];
+    if (c == NULL) {
+      continue;  // deleted, drop the watch
+    }
+    if (c->lits[0] == false_lit) {
+      c->lits[0] = c->lits[1];
+      c->lits[1] = false_lit;
+    }
+    if (lit_value(s, c->lits[0]) == 1) {
+      ws->data[j++] = index;
+      continue;
+    }
+
+    bool moved = false;
+    for (int k = 2; k < c->size; k++) {
+      if (lit_value(s, c->lits[k]) != 0) {
+        c->lits[1] = c->lits[k];
+        c->lits[k] = false_lit;
+        vec_push(s, &s->watches[c->lits[1]], index);
+        moved = true;
+        break;
+      }
+    }
+    if (moved) {
+      continue;
+    }
+
+    ws->data[j++] = index;
+    if (lit_value(s, c->lits[0]) == 0) {
+      s->conflict.size = 0;
+      for (int k = 0; k < c->size; k++) {
+        vec_push(s, &s->conflict, c->lits[k]);
+      }
+      while (i < ws->size) {
+        ws->data[j++] = ws->data[i++];
+      }
+      ws->size = j;
+      return false;
+    }
+    assign(s, c->lits[0], REASON_CLAUSE, index);
+  }
+  ws->size = j;
+  return true;
+}
+
+// Checks the line of a newly set cell holding v: more than half of the
+// cells at v is a conflict, exactly half forces the empty ones to !v
+static bool propagate_balance(t_cdcl *s, int axis, int line, int v) {
+  uint64_t cells = s->lines[axis][v][line];
+  int count = __builtin_popcountll(cells);
+  if (count > s->size / 2) {
+    s->conflict.size = 0;
+    for (; cells; cells &= cells - 1) {
+      vec_push(s, &s->conflict,
+               LIT_NOT(line_lit(s, axis, line, __builtin_ctzll(cells))));
+    }
+    return false;
+  }
+  if (count == s->size / 2) {
+    uint64_t empty = line_mask(s->size) &
+                     ~(s->lines[axis][0][line] | s->lines[axis][1][line]);
+    for (; empty; empty &= empty - 1) {
+      int k = __builtin_ctzll(empty);
+      int var = axis == 0 ? line * s->size + k : k * s->size + line;
+      assign(s, LIT(var, !v), REASON_BALANCE, axis * MAX_GRID_SIZE + line);
+    }
+  }
+  return true;
+}
+
+// If `line` has a single empty cell and its other cells agree with the full
+// line `full`, the empty cell must differ from the one of `full`
+static void propagate_unique_pair(t_cdcl *s, int axis, int line, int full) {
+  uint64_t zeros = s->lines[axis][0][line];
+  uint64_t ones = s->lines[axis][1][line];
+  uint64_t empty = line_mask(s->size) & ~(zeros | ones);
+  if (__builtin_popcountll(empty) != 1 ||
+      (zeros & s->lines[axis][1][full]) || (ones & s->lines[axis][0][full])) {
+    return;
+  }
+  int k = __builtin_ctzll(empty);
+  int var = axis == 0 ? line * s->size + k : k * s->size + line;
+  int v = (s->lines[axis][1][full] >> k) & 1;
+  assign(s, LIT(var, !v), REASON_UNIQUE, axis * MAX_GRID_SIZE + full);
+}
+
+static bool propagate_unique(t_cdcl *s, int axis, int line) {
+  uint64_t mask = line_mask(s->size);
+  uint64_t (*lines)[MAX_GRID_SIZE] = s->lines[axis];
+  uint64_t filled = lines[0][line] | lines[1][line];
+  int nb_empty = s->size - __builtin_popcountll(filled);
+  if (nb_empty > 1) {
+    return true;
+  }
+
+  for (int other = 0; other < s->size; other++) {
+    if (other == line) {
+      continue;
+    }
+    bool other_full = (lines[0][other] | lines[1][other]) == mask;
+    if (nb_empty == 0 && other_full && lines[1][other] == lines[1][line]) {
+      s->conflict.size = 0;
+      for (int k = 0; k < s->size; k++) {
+        vec_push(s, &s->conflict, LIT_NOT(line_lit(s, axis, line, k)));
+        vec_push(s, &s->conflict, LIT_NOT(line_lit(s, axis, other, k)));
+      }
+      return false;
+    }
+    if (nb_empty == 0) {
+      propagate_unique_pair(s, axis, other, line);
+    } else if (other_full) {
+      propagate_unique_pair(s, axis, line, other);
+    }
+  }
+  return true;
+}
+
+// Unit propagation of every literal not propagated yet, fills s->conflict
+// and returns false on a conflict
+static bool propagate(t_cdcl *s) {
+  while (s->qhead < s->trail_size) {
+    int lit = s->trail[s->qhead++];
+    int var = LIT_VAR(lit);
+    int v = s->value[var];
+    if (!propagate_clauses(s, lit)) {
+      return false;
+    }
+    for (int axis = 0; axis < 2; axis++) {
+      int line = line_index(s, axis, var);
+      if (!propagate_balance(s, axis, line, v) ||
+          !propagate_unique(s, axis, line)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static void bump_var(t_cdcl *s, int var) {
+  s->activity[var] += s->bump;
+  if (s->activity[var] > 1e100) {
+    for (int k = 0; k < s->nb_vars; k++) {
+      s->activity[k] *= 1e-100;
+    }
+    s->bump *= 1e-100;
+  }
+}
+
+// First unique implication point analysis of s->conflict, leaves the learnt
+// clause in s->learnt (asserting literal first, then the literal of the
+// highest level) and returns the level to backjump to
+static int analyze(t_cdcl *s) {
+  t_vec *learnt = &s->learnt;
+  learnt->size = 0;
+  vec_push(s, learnt, 0);  // room for the asserting literal
+
+  const t_vec *reason = &s->conflict;
+  int pending = 0;  // literals of the current level still to resolve
+  int lit = -1;
+  int index = s->trail_size - 1;
+  do {
+    for (int k = lit == -1 ? 0 : 1; k < reason->size; k++) {
+      int q = reason->data[k];
+      int var = LIT_VAR(q);
+      if (s->seen[var] || s->level[var] == 0) {
+        continue;
+      }
+      s->seen[var] = 1;
+      bump_var(s, var);
+      if (s->level[var] >= decision_level(s)) {
+        pending++;
+      } else {
+        vec_push(s, learnt, q);
+      }
+    }
+    while (!s->seen[LIT_VAR(s->trail[index])]) {
+      index--;
+    }
+    lit = s->trail[index--];
+    s->seen[LIT_VAR(lit)] = 0;
+    pending--;
+    if (pending > 0) {
+      reason = explain(s, LIT_VAR(lit));
+    }
+  } while (pending > 0);
+  learnt->data[0] = LIT_NOT(lit);
+
+  int level = 0;
+  for (int k = 1; k < learnt->size; k++) {
+    int var = LIT_VAR(learnt->data[k]);
+    s->seen[var] = 0;
+    if (s->level[var] > level) {
+      level = s->level[var];
+      int tmp = learnt->data[1];
+      learnt->data[1] = learnt->data[k];
+      learnt->data[k] = tmp;
+    }
+  }
+  return level;
+}
+
+// Unassigned variable of highest activity, -1 if the grid is full
+static int pick_var(const t_cdcl *s) {
+  int best = -1;
+  for (int var = 0; var < s->nb_vars; var++) {
+    if (s->value[var] == UNASSIGNED &&
+        (best < 0 || s->activity[var] > s->activity[best])) {
+      best = var;
+    }
+  }
+  return best;
+}
+
+static int compare_size(const void *a, const void *b) {
+  const t_clause *ca = *(t_clause *const *)a;
+  const t_clause *cb = *(t_clause *const *)b;
+  return (ca->size > cb->size) - (ca->size < cb->size);
+}
+
+// Deletes the longest half of the learnt clauses, except those that are the
+// reason of an assigned cell. Their watches are dropped by propagate_clauses.
+static void reduce_learnts(t_cdcl *s) {
+  t_clause **learnts = checked_malloc(s, s->nb_learnts * sizeof(t_clause *));
+  int count = 0;
+  for (int k = 0; k < s->nb_clauses; k++) {
+    if (s->clauses[k] != NULL && s->clauses[k]->learnt) {
+      learnts[count++] = s->clauses[k];
+    }
+  }
+  qsort(learnts, count, sizeof(t_clause *), compare_size);
+  int limit = learnts[count / 2]->size;
+  free(learnts);
+
+  for (int k = 0; k < s->nb_clauses; k++) {
+    t_clause *c = s->clauses[k];
+    if (c == NULL || !c->learnt || c->size <= 2 || c->size < limit) {
+      continue;
+    }
+    int var = LIT_VAR(c->lits[0]);
+    if (s->value[var] != UNASSIGNED && s->reason_kind[var] == REASON_CLAUSE &&
+        s->reason_data[var] == k) {
+      continue;
+    }
+    free(c);
+    s->clauses[k] = NULL;
+    s->nb_learnts--;
+  }
+}
+
+// Luby sequence 1 1 2 1 1 2 4 1 1 2 ..., term x (starting at 0)
+static long luby(long x) {
+  long size = 1;
+  int seq = 0;
+  while (size < x + 1) {
+    seq++;
+    size = 2 * size + 1;
+  }
+  while (size - 1 != x) {
+    size = (size - 1) >> 1;
+    seq--;
+    x = x % size;
+  }
+  return 1L << seq;
+}
+
+// s must be zeroed, so that cdcl_free can release what has been allocated
+// if an allocation fails
+static void cdcl_init(t_cdcl *s, int size) {
+  s->size = size;
+  s->nb_vars = size * size;
+  s->value = checked_malloc(s, s->nb_vars * sizeof(int8_t));
+  s->level = checked_malloc(s, s->nb_vars * sizeof(int));
+  s->trail_pos = checked_malloc(s, s->nb_vars * sizeof(int));
+  s->reason_kind = checked_malloc(s, s->nb_vars * sizeof(int8_t));
+  s->reason_data = checked_malloc(s, s->nb_vars * sizeof(int));
+  s->phase = checked_calloc(s, s->nb_vars, sizeof(int8_t));
+  s->activity = checked_calloc(s, s->nb_vars, sizeof(double));
+  s->seen = checked_calloc(s, s->nb_vars, sizeof(int8_t));
+  s->trail = checked_malloc(s, s->nb_vars * sizeof(int));
+  s->watches = checked_calloc(s, 2 * s->nb_vars, sizeof(t_vec));
+  s->clauses = checked_malloc(s, 1024 * sizeof(t_clause *));
+  s->clauses_capacity = 1024;
+  memset(s->value, UNASSIGNED, s->nb_vars * sizeof(int8_t));
+  s->bump = 1;
+  s->max_learnts = 2 * s->nb_vars + 2000;
+
+  // No three identical cells in a row: among three consecutive cells of a
+  // line at least one 0 and at least one 1
+  for (int line = 0; line < size; line++) {
+    for (int k = 0; k + 2 < size; k++) {
+      int row[3] = {line * size + k, line * size + k + 1, line * size + k + 2};
+      int col[3] = {k * size + line, (k + 1) * size + line,
+                    (k + 2) * size + line};
+      for (int v = 0; v < 2; v++) {
+        int lits_row[3] = {LIT(row[0], v), LIT(row[1], v), LIT(row[2], v)};
+        int lits_col[3] = {LIT(col[0], v), LIT(col[1], v), LIT(col[2], v)};
+        add_clause(s, lits_row, 3, false);
+        add_clause(s, lits_col, 3, false);
+      }
+    }
+  }
+}
+
+static void cdcl_free(t_cdcl *s) {
+  for (int k = 0; k < s->nb_clauses; k++) {
+    free(s->clauses[k]);
+  }
+  for (int k = 0; s->watches != NULL && k < 2 * s->nb_vars; k++) {
+    free(s->watches[k].data);
+  }
+  free(s->clauses);
+  free(s->watches);
+  free(s->value);
+  free(s->level);
+  free(s->trail_pos);
+  free(s->reason_kind);
+  free(s->reason_data);
+  free(s->phase);
+  free(s->activity);
+  free(s->seen);
+  free(s->trail);
+  free(s->levels.data);
+  free(s->conflict.data);
+  free(s->reason.data);
+  free(s->learnt.data);
+}
+
+static void emit_solution(const t_cdcl *s, const t_grid *grid,
+                          t_sink *sink) {
+  t_grid solution;
+  grid_copy(grid, &solution);
+  for (int var = 0; var < s->nb_vars; var++) {
+    int i = var / s->size;
+    int j = var % s->size;
+    if (get_cell(i, j, &solution) == '_') {
+      set_cell(i, j, &solution, s->value[var] ? '1' : '0');
+    }
+  }
+  sink_emit(sink, &solution);
+}
+
+// Forbids the decisions that led to the current solution, so that the search
+// goes on with the next one. Returns false when there were no decisions,
+// the solution was the last one.
+static bool block_solution(t_cdcl *s) {
+  int levels = decision_level(s);
+  if (levels == 0) {
+    return false;
+  }
+  t_vec *clause = &s->learnt;
+  clause->size = 0;
+  for (int level = levels - 1; level >= 0; level--) {
+    vec_push(s, clause, LIT_NOT(s->trail[s->levels.data[level]]));
+  }
+  backtrack(s, levels - 1);
+  if (clause->size == 1) {
+    assign(s, clause->data[0], REASON_DECISION, 0);
+  } else {
+    int index = add_clause(s, clause->data, clause->size, false);
+    assign(s, clause->data[0], REASON_CLAUSE, index);
+  }
+  return true;
+}
+
+// Solves grid with clause learning and non-chronological backjumping instead
+// of the chronological backtracking of grid_solver_recursive. The cells of
+// grid are not modified. Returns the number of solutions found (at most one
+// in MODE_FIRST, at most the limit of the sink if it has one), errors are
+// left in the context.
+long grid_solver_cdcl(tkz_context *ctx, t_grid *grid, t_sink *sink,
+                      const t_mode mode) {
+  // On the heap so that its fields keep their values through longjmp
+  t_cdcl *s = calloc(1, sizeof(t_cdcl));
+  if (s == NULL || setjmp(s->out_of_memory) != 0) {
+    context_fail(ctx, TKZ_ERROR_MEMORY,
+                 "could not allocate the conflict-driven solver");
+    if (s != NULL) {
+      cdcl_free(s);
+      free(s);
+    }
+    return sink->count;
+  }
+  cdcl_init(s, grid->size);
+  if (ctx->options.branching == BRANCH_RANDOM) {
+    // random first value of every cell, and random order of the decisions
+    // until the conflicts give the activities a meaning: the solution found
+    // is a random one
+    for (int var = 0; var < s->nb_vars; var++) {
+      uint64_t r = rng_next(ctx->rng);
+      s->phase[var] = r & 1;
+      s->activity[var] = (double)(r >> 11) / (UINT64_C(1) << 53);
+    }
+  }
+
+  bool done = false;
+  for (int var = 0; var < s->nb_vars && !done; var++) {
+    char c = get_cell(var / grid->size, var % grid->size, grid);
+    if (c != '_') {
+      int lit = LIT(var, c == '1');
+      if (lit_value(s, lit) == 0) {
+        done = true;  // contradicts what an earlier given cell propagated
+      } else if (lit_value(s, lit) == UNASSIGNED) {
+        assign(s, lit, REASON_DECISION, 0);
+        done = !propagate(s);
+      }
+    }
+  }
+
+  long restarts = 0;
+  long restart_limit = RESTART_BASE * luby(restarts);
+  long conflicts_since_restart = 0;
+  while (!done && !sink_done(sink, mode)) {
+    if (!propagate(s)) {
+      s->nb_conflicts++;
+      conflicts_since_restart++;
+      if (decision_level(s) == 0) {
+        break;  // no solution left
+      }
+      int level = analyze(s);
+      backtrack(s, level);
+      if (s->learnt.size == 1) {
+        assign(s, s->learnt.data[0], REASON_DECISION, 0);
+      } else {
+        int index = add_clause(s, s->learnt.data, s->learnt.size, true);
+        assign(s, s->learnt.data[0], REASON_CLAUSE, index);
+      }
+      s->bump /= VAR_DECAY;
+      continue;
+    }
+
+    if (conflicts_since_restart >= restart_limit) {
+      backtrack(s, 0);
+      restart_limit = RESTART_BASE * luby(++restarts);
+      conflicts_since_restart = 0;
+      if (s->nb_learnts >= s->max_learnts) {
+        reduce_learnts(s);
+        s->max_learnts += s->max_learnts / 10;
+      }
+      continue;
+    }
+
+    int var = pick_var(s);
+    if (var < 0) {
+      emit_solution(s, grid, sink);
+      done = !block_solution(s);
+      continue;
+    }
+    vec_push(s, &s->levels, s->trail_size);
+    assign(s, LIT(var, s->phase[var]), REASON_DECISION, 0);
+    sink->nodes++;
+  }
+
+  if (ctx->log != NULL) {
+    fprintf(ctx->log, "Conflicts: %ld, restarts: %ld\n", s->nb_conflicts,
+            restarts);
+  }
+  cdcl_free(s);
+  free(s);
+  return sink->count;
+}
@@ -0,0 +1,381 @@
+// pipe2, mkostemp and close_range
+#define _GNU_SOURCE
+
+#include "cnf.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "grid.h"
+#include "libtakuzu.h"
+
+// SAT solvers tried in that order when none is given, they all read the CNF
+// on their standard input and print the model in the competition format
+// ("s SATISFIABLE" then "v" lines)
+static const char *default_solvers[] = {"kissat", "cadical", "cryptominisat5",
+                                        NULL};
+
+// The encoding is generated twice, once to count the variables and clauses
+// for the header and once to print it
+typedef struct {
+  FILE *fd;         // NULL while counting
+  int nb_vars;      // Variables allocated so far
+  long nb_clauses;  // Clauses emitted so far
+} t_cnf;
+
+// Cell (i, j) is variable i * size + j + 1, true if it holds '1'. Auxiliary
+// variables come after the cells.
+static int cell_var(const t_grid *grid, int i, int j) {
+  return i * grid->size + j + 1;
+}
+
+static int new_var(t_cnf *cnf) { return ++cnf->nb_vars; }
+
+static void clause(t_cnf *cnf, const int *lits, int size) {
+  cnf->nb_clauses++;
+  if (cnf->fd == NULL) {
+    return;
+  }
+  for (int k = 0; k < size; k++) {
+    fprintf(cnf->fd, "%d ", lits[k]);
+  }
+  fprintf(cnf->fd, "0\n");
+}
+
+static void clause2(t_cnf *cnf, int a, int b) {
+  int lits[2] = {a, b};
+  clause(cnf, lits, 2);
+}
+
+static void clause3(t_cnf *cnf, int a, int b, int c) {
+  int lits[3] = {a, b, c};
+  clause(cnf, lits, 3);
+}
+
+// At most k of the m literals are true, sequential counter encoding: s[i][j]
+// is implied when at least j + 1 of the literals 0..i are true
+static void at_most(t_cnf *cnf, const int *x, int m, int k) {
+  int s[MAX_GRID_SIZE][MAX_GRID_SIZE / 2];
+  for (int i = 0; i < m - 1; i++) {
+    for (int j = 0; j < k; j++) {
+      s[i][j] = new_var(cnf);
+    }
+  }
+
+  clause2(cnf, -x[0], s[0][0]);
+  for (int j = 1; j < k; j++) {
+    int lit = -s[0][j];
+    clause(cnf, &lit, 1);
+  }
+  for (int i = 1; i < m - 1; i++) {
+    clause2(cnf, -x[i], s[i][0]);
+    clause2(cnf, -s[i - 1][0], s[i][0]);
+    for (int j = 1; j < k; j++) {
+      clause3(cnf, -x[i], -s[i - 1][j - 1], s[i][j]);
+      clause2(cnf, -s[i - 1][j], s[i][j]);
+    }
+    clause2(cnf, -x[i], -s[i - 1][k - 1]);
+  }
+  clause2(cnf, -x[m - 1], -s[m - 2][k - 1]);
+}
+
+// Variables of row (axis 0) or column (axis 1) `line`
+static void line_vars(const t_grid *grid, int axis, int line, int *vars) {
+  for (int k = 0; k < grid->size; k++) {
+    vars[k] = axis == 0 ? cell_var(grid, line, k) : cell_var(grid, k, line);
+  }
+}
+
+static void encode(t_cnf *cnf, const t_grid *grid,
+                   const t_solutions *blocked) {
+  int size = grid->size;
+  cnf->nb_vars = size * size;
+  cnf->nb_clauses = 0;
+
+  // Given cells
+  for (int i = 0; i < size; i++) {
+    for (int j = 0; j < size; j++) {
+      char c = get_cell(i, j, grid);
+      if (c != '_') {
+        int lit = c == '1' ? cell_var(grid, i, j) : -cell_var(grid, i, j);
+        clause(cnf, &lit, 1);
+      }
+    }
+  }
+
+  for (int axis = 0; axis < 2; axis++) {
+    for (int line = 0; line < size; line++) {
+      int x[MAX_GRID_SIZE];
+      line_vars(grid, axis, line, x);
+
+      // No three identical cells in a row
+      for (int k = 0; k + 2 < size; k++) {
+        clause3(cnf, x[k], x[k + 1], x[k + 2]);
+        clause3(cnf, -x[k], -x[k + 1], -x[k + 2]);
+      }
+
+      // Balance: at most size / 2 ones and at most size / 2 zeros
+      int zeros[MAX_GRID_SIZE];
+      for (int k = 0; k < size; k++) {
+        zeros[k] = -x[k];
+      }
+      at_most(cnf, x, size, size / 2);
+      at_most(cnf, zeros, size, size / 2);
+    }
+
+    // Unique lines: d[k] implies that the two lines differ at k, and one of
+    // the d[k] holds
+    for (int a = 0; a < size; a++) {
+      for (int b = a + 1; b < size; b++) {
+        int xa[MAX_GRID_SIZE];
+        int xb[MAX_GRID_SIZE];
+        int d[MAX_GRID_SIZE];
+        line_vars(grid, axis, a, xa);
+        line_vars(grid, axis, b, xb);
+        for (int k = 0; k < size; k++) {
+          d[k] = new_var(cnf);
+          clause3(cnf, -d[k], xa[k], xb[k]);
+          clause3(cnf, -d[k], -xa[k], -xb[k]);
+        }
+        clause(cnf, d, size);
+      }
+    }
+  }
+
+  // Solutions already found, for the enumeration of grid_solver_sat
+  for (int s = 0; blocked != NULL && s < blocked->count; s++) {
+    int lits[MAX_GRID_SIZE * MAX_GRID_SIZE];
+    int count = 0;
+    for (int i = 0; i < size; i++) {
+      for (int j = 0; j < size; j++) {
+        if (get_cell(i, j, grid) == '_') {
+          int var = cell_var(grid, i, j);
+          lits[count++] = get_cell(i, j, blocked->grids[s]) == '1' ? -var : var;
+        }
+      }
+    }
+    clause(cnf, lits, count);
+  }
+}
+
+static void write_blocked(const t_grid *grid, const t_solutions *blocked,
+                          FILE *fd) {
+  t_cnf cnf = {NULL, 0, 0};
+  encode(&cnf, grid, blocked);
+  fprintf(fd, "c takuzu %dx%d, cell (i, j) is variable i * %d + j + 1\n",
+          grid->size, grid->size, grid->size);
+  fprintf(fd, "p cnf %d %ld\n", cnf.nb_vars, cnf.nb_clauses);
+  cnf.fd = fd;
+  encode(&cnf, grid, blocked);
+}
+
+// Writes grid as a DIMACS CNF formula, satisfied by the solutions of the grid
+// (and auxiliary variables for the balance and unique-line rules)
+void cnf_write(const t_grid *grid, FILE *fd) {
+  write_blocked(grid, NULL, fd);
+}
+
+// First solver of default_solvers found on PATH, NULL if none
+static const char *find_solver(void) {
+  const char *path = getenv("PATH");
+  if (path == NULL) {
+    return NULL;
+  }
+  for (int s = 0; default_solvers[s] != NULL; s++) {
+    const char *dir = path;
+    while (*dir != '\0') {
+      size_t length = strcspn(dir, ":");
+      char file[4096];
+      snprintf(file, sizeof(file), "%.*s/%s", (int)length, dir,
+               default_solvers[s]);
+      if (access(file, X_OK) == 0) {
+        return default_solvers[s];
+      }
+      dir += length + (dir[length] == ':');
+    }
+  }
+  return NULL;
+}
+
+// Anonymous temporary file, closed on exec so that the solvers started by
+// other threads don't keep it. NULL if it can't be created.
+static FILE *temporary_file(void) {
+  const char *dir = getenv("TMPDIR");
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/takuzu_sat_XXXXXX",
+           dir != NULL && dir[0] != '\0' ? dir : "/tmp");
+  int fd = mkostemp(path, O_CLOEXEC);
+  if (fd < 0) {
+    return NULL;
+  }
+  unlink(path);
+  FILE *file = fdopen(fd, "w+");
+  if (file == NULL) {
+    close(fd);
+  }
+  return file;
+}
+
+// Writes the formula to the solver. A solver that fails early closes the
+// pipe, which is reported through its exit status rather than by SIGPIPE:
+// the signal is blocked for this thread only (other threads may be writing
+// to their own solver) and the one the write raised is discarded.
+static void write_formula(const t_grid *grid, const t_solutions *blocked,
+                          FILE *fd) {
+  sigset_t pipe_signal;
+  sigset_t previous;
+  sigemptyset(&pipe_signal);
+  sigaddset(&pipe_signal, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &pipe_signal, &previous);
+
+  write_blocked(grid, blocked, fd);
+  fclose(fd);
+
+  sigset_t pending;
+  sigpending(&pending);
+  if (sigismember(&pending, SIGPIPE)) {
+    const struct timespec no_wait = {0, 0};
+    sigtimedwait(&pipe_signal, NULL, &no_wait);
+  }
+  pthread_sigmask(SIG_SETMASK, &previous, NULL);
+}
+
+// Runs the solver on the CNF of grid (minus the blocked solutions), the
+// formula is piped to its standard input and its output goes to a temporary
+// file. Returns 0 if the formula is unsatisfiable, 1 after filling solution
+// with the model, -1 on an error left in the context.
+// Every descriptor is created close-on-exec: in batch mode the threads start
+// solvers at the same time, and a solver that inherited the write end of
+// another one's pipe would keep it from ever seeing the end of its input.
+static int sat_run(tkz_context *ctx, const char *solver, const t_grid *grid,
+                   const t_solutions *blocked, t_grid *solution) {
+  FILE *output = temporary_file();
+  int input[2];
+  if (output == NULL || pipe2(input, O_CLOEXEC) != 0) {
+    context_fail(ctx, TKZ_ERROR_SAT_SOLVER,
+                 "could not create the SAT solver pipes");
+    if (output != NULL) {
+      fclose(output);
+    }
+    return -1;
+  }
+
+  fflush(NULL);
+  pid_t pid = fork();
+  if (pid < 0) {
+    context_fail(ctx, TKZ_ERROR_SAT_SOLVER, "could not start the SAT solver");
+    close(input[0]);
+    close(input[1]);
+    fclose(output);
+    return -1;
+  }
+  if (pid == 0) {
+    // dup2 clears close-on-exec on the copies, the solver keeps nothing but
+    // its standard streams
+    dup2(input[0], STDIN_FILENO);
+    dup2(fileno(output), STDOUT_FILENO);
+    close_range(STDERR_FILENO + 1, ~0U, 0);
+    execlp(solver, solver, (char *)NULL);
+    _exit(127);
+  }
+
+  close(input[0]);
+  FILE *fd = fdopen(input[1], "w");
+  if (fd == NULL) {
+    // the solver reads an empty formula and fails below
+    close(input[1]);
+  } else {
+    write_formula(grid, blocked, fd);
+  }
+
+  int status;
+  waitpid(pid, &status, 0);
+  if (fd == NULL || !WIFEXITED(status) || WEXITSTATUS(status) == 127) {
+    context_fail(ctx, TKZ_ERROR_SAT_SOLVER, "could not run the SAT solver '%s'",
+                 solver);
+    fclose(output);
+    return -1;
+  }
+
+  // Competition format: "s SATISFIABLE" or "s UNSATISFIABLE", then the
+  // model as "v" lines of literals ending with 0
+  rewind(output);
+  grid_copy(grid, solution);
+  int answer = -1;
+  int nb_cells = grid->size * grid->size;
+  char *line = NULL;
+  size_t capacity = 0;
+  while (getline(&line, &capacity, output) != -1) {
+    if (strncmp(line, "s SATISFIABLE", 13) == 0) {
+      answer = 1;
+    } else if (strncmp(line, "s UNSATISFIABLE", 15) == 0) {
+      answer = 0;
+    } else if (line[0] == 'v') {
+      char *token = line + 1;
+      char *end;
+      for (long lit = strtol(token, &end, 10); end != token;
+           lit = strtol(token, &end, 10)) {
+        token = end;
+        long var = lit < 0 ? -lit : lit;
+        if (var >= 1 && var <= nb_cells) {
+          int i = (var - 1) / grid->size;
+          int j = (var - 1) % grid->size;
+          if (get_cell(i, j, solution) == '_') {
+            set_cell(i, j, solution, lit > 0 ? '1' : '0');
+          }
+        }
+      }
+    }
+  }
+  free(line);
+  fclose(output);
+
+  if (answer < 0 || (answer == 1 && !is_grid_full(solution))) {
+    context_fail(ctx, TKZ_ERROR_SAT_SOLVER,
+                 "unexpected output from the SAT solver '%s'", solver);
+    return -1;
+  }
+  return answer;
+}
+
+// Hands the grid to an external SAT solver (the first one of default_solvers
+// found on PATH if solver is NULL). Every further solution is a new run with
+// the previous ones blocked by a clause. Returns the number of solutions
+// found (at most one in MODE_FIRST, at most the limit of the sink if it has
+// one), errors are left in the context.
+long grid_solver_sat(tkz_context *ctx, t_grid *grid, t_sink *sink,
+                     const t_mode mode, const char *solver) {
+  if (solver == NULL) {
+    solver = find_solver();
+    if (solver == NULL) {
+      context_fail(ctx, TKZ_ERROR_SAT_SOLVER,
+                   "no SAT solver found on PATH (kissat, cadical, "
+                   "cryptominisat5)");
+      return 0;
+    }
+  }
+  if (ctx->log != NULL) {
+    fprintf(ctx->log, "Using SAT solver '%s'\n", solver);
+  }
+
+  t_solutions blocked = {NULL, 0, 0};
+  t_grid solution;
+  while (!sink_done(sink, mode) &&
+         sat_run(ctx, solver, grid, &blocked, &solution) == 1) {
+    sink_emit(sink, &solution);
+    if (!add_solution(&solution, &blocked)) {
+      context_fail(ctx, TKZ_ERROR_MEMORY, "could not allocate the solutions");
+      break;
+    }
+  }
+  free_solutions(&blocked);
+  return sink->count;
+}
@@ -0,0 +1,347 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "grid.h"
+#include "libtakuzu.h"
+
+// Header of an index file, followed by the offset of every grid. Numbers are
+// stored in the byte order of the machine that wrote them: `check` no longer
+// reads INDEX_CHECK on a machine of the other order and the index is rebuilt.
+typedef struct {
+  char magic[8];          // INDEX_MAGIC
+  uint64_t check;         // INDEX_CHECK
+  uint64_t corpus_size;   // Bytes of the corpus the index was built from
+  int64_t corpus_mtime;   // Its modification time, in nanoseconds
+  uint64_t nb_grids;      // Offsets that follow the header
+} t_index_header;
+
+#define INDEX_MAGIC "TKZINDEX"
+#define INDEX_CHECK UINT64_C(0x0102030405060708)
+
+// First byte of [line, end) that is not a space or a tab
+static const char *skip_blanks(const char *line, const char *end) {
+  while (line < end && (*line == ' ' || *line == '\t')) {
+    line++;
+  }
+  return line;
+}
+
+// true if [line, end) is blank or a comment, either one ends a grid
+static bool is_separator(const char *line, const char *end) {
+  line = skip_blanks(line, end);
+  return line == end || *line == '#';
+}
+
+// End of the line starting at line: its '\n' or the end of the text. memchr
+// compares a word or a vector register of bytes at a time, so the lines are
+// found much faster than by looking at every byte.
+static const char *line_end(const char *line, const char *end) {
+  const char *newline = memchr(line, '\n', end - line);
+  return newline != NULL ? newline : end;
+}
+
+// Sets the cells of row `row` of grid from [line, end), straight from the
+// text. Returns the number of cells of the line (only counted if grid is
+// NULL, more than grid->size are never set) or -1 on an invalid character.
+static int parse_row(t_grid *grid, int row, const char *line,
+                     const char *end) {
+  int nb_cells = 0;
+  for (; line < end; line++) {
+    if (*line == ' ' || *line == '\t') {
+      // ignore and skip
+    } else if (!check_char(*line)) {
+      return -1;
+    } else {
+      if (grid != NULL && nb_cells < grid->size) {
+        set_cell(row, nb_cells, grid, *line);
+      }
+      nb_cells++;
+    }
+  }
+  return nb_cells;
+}
+
+// Parses the first grid of text, the same way as tkz_grid_read parses a
+// stream (text or binary), without copying it: cells go from the text to the
+// grid.
+tkz_status tkz_grid_parse(tkz_context *ctx, t_grid *grid, const char *text,
+                          size_t length) {
+  context_reset(ctx);
+  const char *line = text;
+  const char *end = text + length;
+
+  // Blank and comment lines before the grid
+  while (line < end && is_separator(line, line_end(line, end))) {
+    line = line_end(line, end) + 1;
+  }
+  if (line >= end) {
+    context_fail(ctx, TKZ_ERROR_EMPTY, "empty file!");
+    return ctx->status;
+  }
+  if (*line == BIN_MAGIC[0]) {
+    // the bit-planes of a binary record are loaded as they are
+    const unsigned char *record = (const unsigned char *)line;
+    size_t available = end - line;
+    size_t record_size =
+        available >= BIN_HEADER_SIZE ? bin_record_size(record) : 0;
+    if (available >= BIN_HEADER_SIZE && record_size == 0) {
+      context_fail(ctx, TKZ_ERROR_SIZE, "invalid binary grid header!");
+    } else if (available < BIN_HEADER_SIZE || record_size > available) {
+      context_fail(ctx, TKZ_ERROR_SHAPE, "truncated binary grid!");
+    } else {
+      bin_decode(ctx, grid, record);
+    }
+    return ctx->status;
+  }
+
+  // The first line gives the grid size
+  const char *eol = line_end(line, end);
+  int lineSize = parse_row(NULL, 0, line, eol);
+  if (lineSize < 0) {
+    context_fail(ctx, TKZ_ERROR_CHARACTER, "invalid character!");
+    return ctx->status;
+  } else if (lineSize > MAX_GRID_SIZE) {
+    context_fail(ctx, TKZ_ERROR_SIZE,
+                 "Invalid size, the first line has more than 64 cells!");
+    return ctx->status;
+  }
+  if (tkz_grid_init(ctx, grid, lineSize) != TKZ_OK) {
+    return ctx->status;
+  }
+  parse_row(grid, 0, line, eol);
+
+  int currentRow = 1;
+  for (line = eol + 1; currentRow < lineSize && line < end;
+       line = eol + 1, currentRow++) {
+    eol = line_end(line, end);
+    if (is_separator(line, eol)) {
+      break;
+    }
+    int nb_cells = parse_row(grid, currentRow, line, eol);
+    if (nb_cells < 0) {
+      context_fail(ctx, TKZ_ERROR_CHARACTER, "invalid character!");
+      return ctx->status;
+    } else if (nb_cells != lineSize) {
+      context_fail(ctx, TKZ_ERROR_SHAPE,
+                   "inconsistent number of char by row!");
+      return ctx->status;
+    }
+  }
+  if (currentRow != lineSize) {
+    context_fail(ctx, TKZ_ERROR_SHAPE, "%d rows for %d columns!", currentRow,
+                 lineSize);
+  }
+  return ctx->status;
+}
+
+// Offsets of the grids of the corpus, in one scan of its lines. A grid starts
+// at the first line that is not blank or a comment, and ends after as many
+// rows as its first line has cells or at a blank or comment line, as in
+// tkz_grid_read. A malformed grid still gets its offset, parsing it reports
+// the error. Only first lines are parsed, the other ones are only looked for.
+static bool build_index(tkz_corpus *corpus) {
+  long capacity = 1024;
+  uint64_t *offsets = malloc(capacity * sizeof(uint64_t));
+  if (offsets == NULL) {
+    return false;
+  }
+
+  long nb_grids = 0;
+  int rows_left = 0;  // Rows of the current grid not seen yet
+  const char *end = corpus->data + corpus->length;
+  for (const char *line = corpus->data; line < end;) {
+    const char *eol = line_end(line, end);
+    bool binary = rows_left == 0 && *line == BIN_MAGIC[0];
+    if (!binary && is_separator(line, eol)) {
+      rows_left = 0;
+    } else if (rows_left > 0) {
+      rows_left--;
+    } else {
+      if (nb_grids == capacity) {
+        capacity *= 2;
+        uint64_t *grown = realloc(offsets, capacity * sizeof(uint64_t));
+        if (grown == NULL) {
+          free(offsets);
+          return false;
+        }
+        offsets = grown;
+      }
+      offsets[nb_grids] = line - corpus->data;
+      nb_grids++;
+      if (binary) {
+        // a binary record is skipped whole, it may hold any byte. Nothing
+        // can be found after an invalid one.
+        size_t record = end - line >= BIN_HEADER_SIZE
+                            ? bin_record_size((const unsigned char *)line)
+                            : 0;
+        line = record > 0 ? line + record : end;
+        continue;
+      }
+      // a grid without a valid size goes on up to the next separator
+      int size = parse_row(NULL, 0, line, eol);
+      rows_left = tkz_valid_size(size) ? size - 1 : INT_MAX;
+    }
+    line = eol + 1;
+  }
+
+  corpus->offsets = offsets;
+  corpus->nb_grids = nb_grids;
+  return true;
+}
+
+// Maps the index file filename if it was built from the corpus as it is now
+static bool load_index(tkz_corpus *corpus, const char *filename,
+                       const struct stat *corpus_stat) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(t_index_header)) {
+    close(fd);
+    return false;
+  }
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+
+  const t_index_header *header = map;
+  if (memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+      header->check != INDEX_CHECK ||
+      header->corpus_size != (uint64_t)corpus_stat->st_size ||
+      header->corpus_mtime !=
+          (int64_t)corpus_stat->st_mtim.tv_sec * 1000000000 +
+              corpus_stat->st_mtim.tv_nsec ||
+      header->nb_grids !=
+          (st.st_size - sizeof(t_index_header)) / sizeof(uint64_t)) {
+    munmap(map, st.st_size);
+    return false;
+  }
+
+  corpus->index_map = map;
+  corpus->index_length = st.st_size;
+  corpus->offsets = (const uint64_t *)(header + 1);
+  corpus->nb_grids = header->nb_grids;
+  return true;
+}
+
+static bool save_index(const tkz_corpus *corpus, const char *filename,
+                       const struct stat *corpus_stat) {
+  FILE *fd = fopen(filename, "wb");
+  if (fd == NULL) {
+    return false;
+  }
+  t_index_header header;
+  memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+  header.check = INDEX_CHECK;
+  header.corpus_size = corpus_stat->st_size;
+  header.corpus_mtime = (int64_t)corpus_stat->st_mtim.tv_sec * 1000000000 +
+                        corpus_stat->st_mtim.tv_nsec;
+  header.nb_grids = corpus->nb_grids;
+  fwrite(&header, sizeof(header), 1, fd);
+  fwrite(corpus->offsets, sizeof(uint64_t), corpus->nb_grids, fd);
+  bool ok = !ferror(fd);
+  return fclose(fd) == 0 && ok;
+}
+
+// Maps the file filename of grids in memory and finds where each grid starts.
+// If index_filename is not NULL, the offsets are read from that file when it
+// was built from the corpus as it is now, otherwise they are computed and
+// saved to it, so that the next opening does not scan the corpus again.
+tkz_status tkz_corpus_open(tkz_context *ctx, tkz_corpus *corpus,
+                           const char *filename, const char *index_filename) {
+  context_reset(ctx);
+  corpus->data = NULL;
+  corpus->length = 0;
+  corpus->offsets = NULL;
+  corpus->nb_grids = 0;
+  corpus->index_map = NULL;
+  corpus->index_length = 0;
+
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    context_fail(ctx, TKZ_ERROR_IO, "could not open '%s': %s", filename,
+                 strerror(errno));
+    return ctx->status;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    context_fail(ctx, TKZ_ERROR_IO, "'%s' is not a regular file", filename);
+    return ctx->status;
+  }
+  // an empty file can't be mapped, it simply has no grid
+  if (st.st_size > 0) {
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+      close(fd);
+      context_fail(ctx, TKZ_ERROR_IO, "could not map '%s': %s", filename,
+                   strerror(errno));
+      return ctx->status;
+    }
+    corpus->data = map;
+    corpus->length = st.st_size;
+  }
+  close(fd);
+
+  if (index_filename != NULL && load_index(corpus, index_filename, &st)) {
+    return TKZ_OK;
+  }
+  if (!build_index(corpus)) {
+    tkz_corpus_close(corpus);
+    context_fail(ctx, TKZ_ERROR_MEMORY, "could not index '%s'", filename);
+    return ctx->status;
+  }
+  if (index_filename != NULL && !save_index(corpus, index_filename, &st)) {
+    tkz_corpus_close(corpus);
+    context_fail(ctx, TKZ_ERROR_IO, "could not write the index '%s'",
+                 index_filename);
+  }
+  return ctx->status;
+}
+
+// Parses the grid number n (from 0) of the corpus
+tkz_status tkz_corpus_grid(tkz_context *ctx, const tkz_corpus *corpus, long n,
+                           t_grid *grid) {
+  context_reset(ctx);
+  if (n < 0 || n >= corpus->nb_grids) {
+    context_fail(ctx, TKZ_ERROR_ARGUMENT,
+                 "no grid %ld, the corpus has %ld grids", n + 1,
+                 corpus->nb_grids);
+    return ctx->status;
+  }
+  uint64_t offset = corpus->offsets[n];
+  if (offset >= corpus->length) {
+    context_fail(ctx, TKZ_ERROR_IO, "grid %ld is out of the corpus", n + 1);
+    return ctx->status;
+  }
+  return tkz_grid_parse(ctx, grid, corpus->data + offset,
+                        corpus->length - offset);
+}
+
+void tkz_corpus_close(tkz_corpus *corpus) {
+  if (corpus->index_map != NULL) {
+    munmap(corpus->index_map, corpus->index_length);
+  } else {
+    free((uint64_t *)corpus->offsets);
+  }
+  if (corpus->data != NULL) {
+    munmap((void *)corpus->data, corpus->length);
+  }
+  corpus->data = NULL;
+  corpus->length = 0;
+  corpus->offsets = NULL;
+  corpus->nb_grids = 0;
+  corpus->index_map = NULL;
+}
@@ -1,227 +1,322 @@
 #include "grid.h"
 
-#include <errno.h>
-#include <getopt.h>
-#include <limits.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
 
-#include "takuzu.h"
+#include "cdcl.h"
+#include "cnf.h"
+#include "parallel.h"
+#include "patterns.h"
+#include "rng.h"
+#include "symmetry.h"
+
+// Check if a character is a valid takuzu grid character
+bool check_char(char c) { return c == '0' || c == '1' || c == '_'; }
+
+// Initialize an empty t_grid structure of the given size, which must be
+// valid (see tkz_valid_size)
+void grid_allocate(t_grid *g, int size) {
+  // An empty grid has no bit set in any of its masks
+  memset(g, 0, sizeof(*g));
+  g->size = size;
+  g->empty_cells = size * size;
+}
 
-void grid_copy(t_grid *gs, t_grid *gd) {
-  gd->size = gs->size;
-  gd->grid = malloc(gd->size * sizeof(char *));
-  for (int i = 0; i < gd->size; i++) {
-    gd->grid[i] = malloc(gd->size * sizeof(char));
+// Release a t_grid structure
+// The masks live inside the structure so there is nothing left on the heap,
+// the grid is only reset so that it can't be used by mistake
+void grid_free(t_grid *g) {
+  if (g == NULL) {
+    return;
   }
 
-  for (int i = 0; i < gd->size; i++) {
-    for (int j = 0; j < gd->size; j++) {
-      gd->grid[i][j] = gs->grid[i][j];
+  g->size = 0;
+}
+
+// spread_bits[b] has byte k set to bit k of b (byte k being the k-th least
+// significant byte of the value)
+#define SPREAD(b)                                                         \
+  ((uint64_t)((b) & 1) | (uint64_t)((b) >> 1 & 1) << 8 |                 \
+   (uint64_t)((b) >> 2 & 1) << 16 | (uint64_t)((b) >> 3 & 1) << 24 |     \
+   (uint64_t)((b) >> 4 & 1) << 32 | (uint64_t)((b) >> 5 & 1) << 40 |     \
+   (uint64_t)((b) >> 6 & 1) << 48 | (uint64_t)((b) >> 7 & 1) << 56)
+#define SPREAD4(b) SPREAD(b), SPREAD(b + 1), SPREAD(b + 2), SPREAD(b + 3)
+#define SPREAD16(b) SPREAD4(b), SPREAD4(b + 4), SPREAD4(b + 8), SPREAD4(b + 12)
+#define SPREAD64(b) \
+  SPREAD16(b), SPREAD16(b + 16), SPREAD16(b + 32), SPREAD16(b + 48)
+static const uint64_t spread_bits[256] = {SPREAD64(0), SPREAD64(64),
+                                          SPREAD64(128), SPREAD64(192)};
+
+// Writes the cells of a line given by its masks to out, 8 at a time: every
+// byte starts as '_' and the bits of the masks, spread one per byte, turn it
+// into '0' or '1'. No byte can borrow from the next one.
+static void render_line(uint64_t zeros, uint64_t ones, int size, char *out) {
+  for (int j = 0; j < size; j += 8) {
+    uint64_t chars = UINT64_C(0x5f5f5f5f5f5f5f5f) -
+                     spread_bits[zeros >> j & 0xff] * ('_' - '0') -
+                     spread_bits[ones >> j & 0xff] * ('_' - '1');
+    int nb_chars = size - j < 8 ? size - j : 8;
+    for (int k = 0; k < nb_chars; k++) {
+      out[j + k] = chars >> (8 * k);
     }
   }
 }
 
-char get_cell(int i, int j, t_grid *g) {
-  // Out of bounds
-  if (i < 0 || i >= g->size || j < 0 || j >= g->size) {
-    fprintf(stderr,
-            "ERROR -> tried to get a cell out of bounds (%d, %d) in a grid "
-            "of size %d\n",
-            i, j, g->size);
-    exit(EXIT_FAILURE);
+// Writes grid as text to out, which must hold TKZ_TEXT_SIZE bytes: a line
+// per row, or with one_line every row on a single line. Returns the number
+// of bytes written (there is no terminating '\0').
+size_t grid_render(const t_grid *g, char *out, bool one_line) {
+  char *p = out;
+  for (int i = 0; i < g->size; i++) {
+    render_line(g->rows[0][i], g->rows[1][i], g->size, p);
+    p += g->size;
+    if (!one_line) {
+      *p++ = '\n';
+    }
+  }
+  if (one_line) {
+    *p++ = '\n';
   }
-  return g->grid[i][j];
+  return p - out;
 }
 
-void set_cell(int i, int j, t_grid *g, char v) {
-  // Invalid character
-  if (!check_char(v)) {
-    fprintf(stderr,
-            "ERROR -> tried to insert an invalid character ('%c') in a grid \n",
-            v);
-    exit(EXIT_FAILURE);
+// The grid is rendered first, so that it is a single write
+void grid_print(const t_grid *g, FILE *fd) {
+  char text[TKZ_TEXT_SIZE];
+  fwrite(text, 1, grid_render(g, text, false), fd);
+}
+
+// The copy does not share the undo log of the source grid
+void grid_copy(const t_grid *gs, t_grid *gd) {
+  *gd = *gs;
+  gd->trail = NULL;
+}
+
+// Mask with the `size` lowest bits set, i.e. every cell of a line
+uint64_t line_mask(int size) {
+  return size == 64 ? UINT64_MAX : (UINT64_C(1) << size) - 1;
+}
+
+// The cell must be in the grid, tkz_grid_get checks it
+char get_cell(int i, int j, const t_grid *g) {
+  uint64_t bit = UINT64_C(1) << j;
+  if (g->rows[0][i] & bit) {
+    return '0';
   }
-  // Out of bounds
-  if (i < 0 || i >= g->size || j < 0 || j >= g->size) {
-    fprintf(stderr,
-            "ERROR -> tried to insert a cell out of bounds (%d, %d) in a grid "
-            "of size %d\n",
-            i, j, g->size);
-    exit(EXIT_FAILURE);
+  if (g->rows[1][i] & bit) {
+    return '1';
   }
+  return '_';
+}
 
-  g->grid[i][j] = v;
+static int line_set_slot(const t_line_set *set, uint64_t key) {
+  int slot = (key * UINT64_C(0x9E3779B97F4A7C15)) >> 57;
+  while (set->counts[slot] != 0 && set->keys[slot] != key) {
+    slot = (slot + 1) % LINE_SET_SIZE;
+  }
+  return slot;
 }
 
-bool is_row_empty(int i, t_grid *g) {
-  for (int j = 0; j < g->size; j++) {
-    if (get_cell(i, j, g) != '_') {
-      return false;
+// Number of full lines of the set equal to `key`
+static int line_set_count(const t_line_set *set, uint64_t key) {
+  return set->counts[line_set_slot(set, key)];
+}
+
+// Adds a full line, returns true if an identical line was already there
+static bool line_set_insert(t_line_set *set, uint64_t key) {
+  int slot = line_set_slot(set, key);
+  set->keys[slot] = key;
+  return set->counts[slot]++ > 0;
+}
+
+// Removes a full line, returns true if an identical line is still there
+static bool line_set_remove(t_line_set *set, uint64_t key) {
+  int slot = line_set_slot(set, key);
+  if (--set->counts[slot] > 0) {
+    return true;
+  }
+  // backward shift deletion: move back the entries of the probe sequence
+  // that can't be reached anymore through the freed slot
+  int hole = slot;
+  for (int next = (hole + 1) % LINE_SET_SIZE; set->counts[next] != 0;
+       next = (next + 1) % LINE_SET_SIZE) {
+    int home = (set->keys[next] * UINT64_C(0x9E3779B97F4A7C15)) >> 57;
+    if ((next - home + LINE_SET_SIZE) % LINE_SET_SIZE >=
+        (next - hole + LINE_SET_SIZE) % LINE_SET_SIZE) {
+      set->keys[hole] = set->keys[next];
+      set->counts[hole] = set->counts[next];
+      set->counts[next] = 0;
+      hole = next;
     }
   }
-  return true;
+  return false;
 }
 
-bool is_col_empty(int j, t_grid *g) {
-  for (int i = 0; i < g->size; i++) {
-    if (get_cell(i, j, g) != '_') {
-      return false;
-    }
+// Keeps the set of full lines and the number of duplicates up to date while
+// a line goes from (zeros, ones) = before to after
+static void update_full_lines(t_grid *g, t_line_set *set, uint64_t zeros_before,
+                              uint64_t ones_before, uint64_t zeros_after,
+                              uint64_t ones_after) {
+  uint64_t full = line_mask(g->size);
+  if ((zeros_before | ones_before) == full &&
+      line_set_remove(set, ones_before)) {
+    g->duplicates--;
+  }
+  if ((zeros_after | ones_after) == full && line_set_insert(set, ones_after)) {
+    g->duplicates++;
   }
-  return true;
 }
 
-bool is_row_full(int i, t_grid *g) {
-  for (int j = 0; j < g->size; j++) {
-    if (get_cell(i, j, g) == '_') {
-      return false;
-    }
+// Updates the masks of (i, j) without any check nor recording it in the trail
+static void write_cell(int i, int j, t_grid *g, char v) {
+  uint64_t row_bit = UINT64_C(1) << j;
+  uint64_t col_bit = UINT64_C(1) << i;
+  bool was_empty = ((g->rows[0][i] | g->rows[1][i]) & row_bit) == 0;
+  g->empty_cells += (v == '_') - was_empty;
+  g->dirty_rows |= col_bit;
+  g->dirty_cols |= row_bit;
+
+  uint64_t row_before[2] = {g->rows[0][i], g->rows[1][i]};
+  uint64_t col_before[2] = {g->cols[0][j], g->cols[1][j]};
+  for (int b = 0; b < 2; b++) {
+    g->rows[b][i] &= ~row_bit;
+    g->cols[b][j] &= ~col_bit;
   }
-  return true;
+  if (v != '_') {
+    g->rows[v - '0'][i] |= row_bit;
+    g->cols[v - '0'][j] |= col_bit;
+  }
+
+  update_full_lines(g, &g->full_rows, row_before[0], row_before[1],
+                    g->rows[0][i], g->rows[1][i]);
+  update_full_lines(g, &g->full_cols, col_before[0], col_before[1],
+                    g->cols[0][j], g->cols[1][j]);
 }
 
-bool is_col_full(int j, t_grid *g) {
-  for (int i = 0; i < g->size; i++) {
-    if (get_cell(i, j, g) == '_') {
-      return false;
+// Records that (i, j) held `old` before being modified. The searches only
+// set empty cells and undo them before setting them again, so the trail never
+// holds more entries than the grid has cells, see trail_init.
+static void trail_push(t_trail *t, int i, int j, char old) {
+  int value = old == '_' ? 2 : old - '0';
+  t->cells[t->length++] = (uint16_t)((i * MAX_GRID_SIZE + j) << 2 | value);
+}
+
+// The cell must be in the grid and v a valid character, tkz_grid_set checks
+// them
+void set_cell(int i, int j, t_grid *g, char v) {
+  g->queue_rows |= UINT64_C(1) << i;
+  g->queue_cols |= UINT64_C(1) << j;
+  if (g->trail != NULL) {
+    char old = get_cell(i, j, g);
+    if (old != v) {
+      trail_push(g->trail, i, j, old);
     }
   }
-  return true;
+  write_cell(i, j, g, v);
+}
+
+// Allocate an undo log able to record every cell of a grid of the given size
+// without growing, returns false if the allocation fails
+bool trail_init(t_trail *t, int size) {
+  t->length = 0;
+  t->capacity = size * size;
+  t->cells = malloc(t->capacity * sizeof(uint16_t));
+  return t->cells != NULL;
+}
+
+void trail_free(t_trail *t) {
+  free(t->cells);
+  t->cells = NULL;
+  t->length = 0;
+  t->capacity = 0;
+}
+
+// Position to give to trail_undo to come back to the current state of g
+int trail_mark(const t_grid *g) { return g->trail->length; }
+
+// Undo every cell set since `mark` was taken, most recent first
+void trail_undo(t_grid *g, int mark) {
+  t_trail *t = g->trail;
+  while (t->length > mark) {
+    uint16_t entry = t->cells[--t->length];
+    int cell = entry >> 2;
+    write_cell(cell / MAX_GRID_SIZE, cell % MAX_GRID_SIZE, g,
+               "01_"[entry & 3]);
+  }
+}
+
+bool is_row_empty(int i, t_grid *g) {
+  return (g->rows[0][i] | g->rows[1][i]) == 0;
+}
+
+bool is_col_empty(int j, t_grid *g) {
+  return (g->cols[0][j] | g->cols[1][j]) == 0;
+}
+
+bool is_row_full(int i, t_grid *g) {
+  return (g->rows[0][i] | g->rows[1][i]) == line_mask(g->size);
+}
+
+bool is_col_full(int j, t_grid *g) {
+  return (g->cols[0][j] | g->cols[1][j]) == line_mask(g->size);
+}
+
+// true if the line has three consecutive cells set in `m`
+static bool has_triple(uint64_t m) { return (m & (m >> 1) & (m >> 2)) != 0; }
+
+// Checks a single line given by its masks against the rules that only
+// depend on the line itself
+static bool is_line_consistent(uint64_t zeros, uint64_t ones, int size) {
+  return !has_triple(zeros) && !has_triple(ones) &&
+         __builtin_popcountll(zeros) <= size / 2 &&
+         __builtin_popcountll(ones) <= size / 2;
 }
 
 // a.no identical lines / columns (only check full lines / columns)
 // b.no more than three consecutive zeros and ones in rows and columns.
+// c.no more zeros or ones than half the size of a line
+// Only the lines modified since the last successful call are checked, a line
+// that has not changed can't have become inconsistent
 bool is_consistent(t_grid *g) {
-  // check for identical rows
-  for (int i = 0; i < g->size; i++) {
-    if (!is_row_full(i, g)) {
-      continue;
-    }
-    for (int j = i + 1; j < g->size; j++) {
-      bool identical = true;
-      for (int k = 0; k < g->size; k++) {
-        if (get_cell(i, k, g) != get_cell(j, k, g)) {
-          identical = false;
-          break;
-        }
-      }
-      if (identical) {
-        if (sw.verbose) {
-          fprintf(sw.output_file,
-                  "Grid is not consistent : rows %d and %d are identical\n", i,
-                  j);
-        }
-        return false;
-      }
-    }
-  }
-
-  // check for identical columns
-  for (int j = 0; j < g->size; j++) {
-    if (!is_col_full(j, g)) {
-      continue;
-    }
-    for (int i = j + 1; i < g->size; i++) {
-      bool identical = true;
-      for (int k = 0; k < g->size; k++) {
-        if (get_cell(k, i, g) != get_cell(k, j, g)) {
-          identical = false;
-          break;
-        }
-      }
-      if (identical) {
-        if (sw.verbose) {
-          fprintf(sw.output_file,
-                  "Grid is not consistent : columns %d and %d are identical\n",
-                  i, j);
-        }
-        return false;
-      }
-    }
+  // identical full lines, in any row or column, are counted by set_cell
+  if (g->duplicates > 0) {
+    return false;
   }
 
-  // check for more than three consecutive zeros and ones in rows and columns
-  for (int i = 0; i < g->size; i++) {
-    int zeros = 0;
-    int ones = 0;
-    for (int j = 0; j < g->size; j++) {
-      if (get_cell(i, j, g) == '0') {
-        zeros++;
-        ones = 0;
-      } else if (get_cell(i, j, g) == '1') {
-        ones++;
-        zeros = 0;
-      } else {
-        zeros = 0;
-        ones = 0;
-      }
-      if (zeros > 2 || ones > 2) {
-        if (sw.verbose) {
-          fprintf(sw.output_file,
-                  "Grid is not consistent : more than three consecutive zeros "
-                  "and ones in rows\n");
-        }
-        return false;
-      }
+  for (uint64_t dirty = g->dirty_rows; dirty; dirty &= dirty - 1) {
+    int i = __builtin_ctzll(dirty);
+    if (!is_line_consistent(g->rows[0][i], g->rows[1][i], g->size)) {
+      return false;
     }
   }
 
-  for (int j = 0; j < g->size; j++) {
-    int zeros = 0;
-    int ones = 0;
-    for (int i = 0; i < g->size; i++) {
-      if (get_cell(i, j, g) == '0') {
-        zeros++;
-        ones = 0;
-      } else if (get_cell(i, j, g) == '1') {
-        ones++;
-        zeros = 0;
-      } else {
-        zeros = 0;
-        ones = 0;
-      }
-      if (zeros > 2 || ones > 2) {
-        if (sw.verbose) {
-          fprintf(sw.output_file,
-                  "Grid is not consistent : more than three consecutive zeros "
-                  "and ones in columns\n");
-        }
-        return false;
-      }
+  for (uint64_t dirty = g->dirty_cols; dirty; dirty &= dirty - 1) {
+    int j = __builtin_ctzll(dirty);
+    if (!is_line_consistent(g->cols[0][j], g->cols[1][j], g->size)) {
+      return false;
     }
   }
 
+  g->dirty_rows = 0;
+  g->dirty_cols = 0;
   return true;
 }
 
-bool is_grid_full(t_grid *g) {
-  for (int i = 0; i < g->size; i++) {
-    for (int j = 0; j < g->size; j++) {
-      if (get_cell(i, j, g) == '_') {
-        return false;
-      }
-    }
-  }
-  return true;
-}
+bool is_grid_full(t_grid *g) { return g->empty_cells == 0; }
 
 // returns true if a grid is full (no empty cells) and meets all the
 // constraints of the Takuzu
 bool is_valid(t_grid *g) {
-  if (sw.verbose) {
-    fprintf(sw.output_file, "Checking validity...\n");
-  }
   return is_consistent(g) && is_grid_full(g);
 }
 
-void grid_choice_apply(t_grid *grid, const choice_t choice) {
-  if (sw.verbose) {
-    printf("Choice => (%d,%d)=%c\n", choice.row, choice.column, choice.choice);
+void grid_choice_apply(tkz_context *ctx, t_grid *grid, const choice_t choice) {
+  if (ctx->log != NULL) {
+    fprintf(ctx->log, "Choice => (%d,%d)=%c\n", choice.row, choice.column,
+            choice.choice);
   }
   set_cell(choice.row, choice.column, grid, choice.choice);
 }
@@ -235,407 +330,786 @@ void grid_choice_print(const choice_t choice, FILE *fd) {
           choice.choice);
 }
 
-// returns a random choice from a grid, the choice is always valid (the cell is
-// empty) otherwise, we error out
-choice_t grid_choice(t_grid *grid) {
-  if (is_grid_full(grid)) {
-    fprintf(stderr, "ERROR -> tried to get a choice from a full grid\n");
-    exit(EXIT_FAILURE);
-  }
-  choice_t choice;
-  choice.row = rand() % grid->size;
-  choice.column = rand() % grid->size;
-  choice.choice = rand() % 2 == 0 ? '0' : '1';
-  if (get_cell(choice.row, choice.column, grid) != '_') {
-    return grid_choice(grid);
+static uint64_t row_empty_cells(const t_grid *g, int i) {
+  return ~(g->rows[0][i] | g->rows[1][i]) & line_mask(g->size);
+}
+
+static uint64_t col_empty_cells(const t_grid *g, int j) {
+  return ~(g->cols[0][j] | g->cols[1][j]) & line_mask(g->size);
+}
+
+// The value a line needs the most, i.e. the one it has the fewest of
+static char scarcest_value(uint64_t zeros, uint64_t ones) {
+  return __builtin_popcountll(zeros) <= __builtin_popcountll(ones) ? '0' : '1';
+}
+
+// A uniformly random empty cell and value
+static choice_t grid_choice_random(t_grid *grid, uint64_t rng[4]) {
+  int n = rng_below(rng, grid->empty_cells);
+  choice_t choice = {0, 0, rng_next(rng) >> 63 == 0 ? '0' : '1'};
+  for (int i = 0; i < grid->size; i++) {
+    uint64_t empty = row_empty_cells(grid, i);
+    int count = __builtin_popcountll(empty);
+    if (n < count) {
+      // drop the n first empty cells of the row
+      while (n-- > 0) {
+        empty &= empty - 1;
+      }
+      choice.row = i;
+      choice.column = __builtin_ctzll(empty);
+      break;
+    }
+    n -= count;
   }
   return choice;
 }
 
-void add_solution(t_grid *grid, t_grid **solutions, int *nb_solutions) {
-  if (sw.verbose) {
-    fprintf(sw.output_file, "Adding solution...\n");
+// An empty cell of the line (row or column) with the fewest empty cells. In
+// that line we take the cell whose crossing line is the most filled too, and
+// give it the value the line is the most short of.
+static choice_t grid_choice_line(t_grid *grid) {
+  int best_empty = grid->size + 1;
+  int best_line = 0;
+  bool best_is_row = true;
+  for (int k = 0; k < grid->size; k++) {
+    int row = __builtin_popcountll(row_empty_cells(grid, k));
+    int col = __builtin_popcountll(col_empty_cells(grid, k));
+    if (row > 0 && row < best_empty) {
+      best_empty = row;
+      best_line = k;
+      best_is_row = true;
+    }
+    if (col > 0 && col < best_empty) {
+      best_empty = col;
+      best_line = k;
+      best_is_row = false;
+    }
   }
 
-  solutions[*nb_solutions] = malloc(sizeof(t_grid));
-  grid_copy(grid, solutions[*nb_solutions]);
-  *nb_solutions += 1;
+  choice_t choice = {0, 0, '0'};
+  int best_cross = grid->size + 1;
+  if (best_is_row) {
+    for (uint64_t e = row_empty_cells(grid, best_line); e; e &= e - 1) {
+      int j = __builtin_ctzll(e);
+      int cross = __builtin_popcountll(col_empty_cells(grid, j));
+      if (cross < best_cross) {
+        best_cross = cross;
+        choice.row = best_line;
+        choice.column = j;
+      }
+    }
+    choice.choice =
+        scarcest_value(grid->rows[0][best_line], grid->rows[1][best_line]);
+  } else {
+    for (uint64_t e = col_empty_cells(grid, best_line); e; e &= e - 1) {
+      int i = __builtin_ctzll(e);
+      int cross = __builtin_popcountll(row_empty_cells(grid, i));
+      if (cross < best_cross) {
+        best_cross = cross;
+        choice.row = i;
+        choice.column = best_line;
+      }
+    }
+    choice.choice =
+        scarcest_value(grid->cols[0][best_line], grid->cols[1][best_line]);
+  }
+  return choice;
 }
 
-void free_solutions(t_grid **solutions, int nb_solutions) {
-  if (solutions == NULL) {
-    return;
+// An empty cell whose row or column is the closest to having half of its
+// cells of one value. The value chosen is the one reaching that limit so that
+// the first branch fills the rest of the line right away.
+static choice_t grid_choice_balance(t_grid *grid) {
+  choice_t choice = {0, 0, '0'};
+  int best = -1;
+  for (int i = 0; i < grid->size; i++) {
+    for (uint64_t e = row_empty_cells(grid, i); e; e &= e - 1) {
+      int j = __builtin_ctzll(e);
+      int counts[4] = {__builtin_popcountll(grid->rows[0][i]),
+                       __builtin_popcountll(grid->rows[1][i]),
+                       __builtin_popcountll(grid->cols[0][j]),
+                       __builtin_popcountll(grid->cols[1][j])};
+      for (int k = 0; k < 4; k++) {
+        if (counts[k] > best) {
+          best = counts[k];
+          choice.row = i;
+          choice.column = j;
+          choice.choice = k % 2 == 0 ? '0' : '1';
+        }
+      }
+    }
   }
+  return choice;
+}
+
+// Number of cells set by applying the heuristics after (i, j) = v, or -1 if
+// they find a contradiction. The grid is left untouched.
+static int probe_cell(tkz_context *ctx, t_grid *grid, int i, int j, char v) {
+  int mark = trail_mark(grid);
+  set_cell(i, j, grid, v);
+  int count = apply_heuristics(ctx, grid) ? trail_mark(grid) - mark : -1;
+  trail_undo(grid, mark);
+  return count;
+}
 
-  for (int i = 0; i < nb_solutions; i++) {
-    grid_free(solutions[i]);
-    free(solutions[i]);
+// The cell whose weakest value forces the most cells once propagated (ties are
+// broken by the total over both values). A cell for which one value leads to
+// a contradiction is taken right away: that branch fails immediately and the
+// other one starts with the cell forced.
+static choice_t grid_choice_propagation(tkz_context *ctx, t_grid *grid) {
+  choice_t choice = {0, 0, '0'};
+  int best_min = -1;
+  int best_sum = -1;
+  for (int i = 0; i < grid->size; i++) {
+    for (uint64_t e = row_empty_cells(grid, i); e; e &= e - 1) {
+      int j = __builtin_ctzll(e);
+      int zero = probe_cell(ctx, grid, i, j, '0');
+      int one = probe_cell(ctx, grid, i, j, '1');
+      if (zero < 0 || one < 0) {
+        choice_t forced = {i, j, zero < 0 ? '0' : '1'};
+        return forced;
+      }
+      int min = zero < one ? zero : one;
+      if (min > best_min || (min == best_min && zero + one > best_sum)) {
+        best_min = min;
+        best_sum = zero + one;
+        choice.row = i;
+        choice.column = j;
+        choice.choice = zero >= one ? '0' : '1';
+      }
+    }
   }
-  free(solutions);
+  return choice;
 }
 
-bool grid_solver(t_grid *grid, const t_mode mode) {
-  if (sw.verbose) {
-    fprintf(sw.output_file, "Solving grid...\n");
+// returns a choice from a grid according to the branching policy, the choice
+// is always valid (the cell is empty), the grid must not be full
+// Every policy but BRANCH_RANDOM is deterministic, it draws from rng (the one
+// of ctx, or of the thread when threads share ctx)
+choice_t grid_choice(tkz_context *ctx, t_grid *grid, t_branching policy,
+                     uint64_t rng[4]) {
+  switch (policy) {
+    case BRANCH_RANDOM:
+      return grid_choice_random(grid, rng);
+    case BRANCH_BALANCE:
+      return grid_choice_balance(grid);
+    case BRANCH_PROPAGATION:
+      // probing needs to be able to roll back what it tries
+      if (grid->trail != NULL) {
+        return grid_choice_propagation(ctx, grid);
+      }
+      return grid_choice_line(grid);
+    case BRANCH_LINE:
+    default:
+      return grid_choice_line(grid);
   }
+}
 
-  if (!is_consistent(grid)) {
-    if (sw.verbose) {
-      fprintf(sw.output_file,
-              "Impossible to solve starting grid is inconsistent\n");
+// Keeps a copy of grid, returns false if it could not be allocated (the list
+// is left as it was)
+bool add_solution(const t_grid *grid, t_solutions *solutions) {
+  if (solutions->count == solutions->capacity) {
+    int capacity = solutions->capacity == 0 ? 1 : solutions->capacity * 2;
+    t_grid **grids = realloc(solutions->grids, capacity * sizeof(t_grid *));
+    if (grids == NULL) {
+      return false;
     }
-    return NULL;
+    solutions->grids = grids;
+    solutions->capacity = capacity;
+  }
+  t_grid *copy = malloc(sizeof(t_grid));
+  if (copy == NULL) {
+    return false;
   }
+  grid_copy(grid, copy);
+  solutions->grids[solutions->count++] = copy;
+  return true;
+}
 
-  // Also handles the case where the grid is already solved
-  if (is_grid_full(grid)) {
-    if (sw.verbose) {
-      fprintf(sw.output_file, "Starting grid is already completed\n");
-    }
-    return grid;
+// Sink callback keeping a copy of every solution in a t_solutions list, the
+// copies that can't be allocated are dropped
+void collect_solution(const t_grid *solution, void *data) {
+  add_solution(solution, data);
+}
+
+// true once the search can stop: the first solution has been found in
+// MODE_FIRST, the sink has received as many solutions as its limit, or the
+// search has used up its nodes
+bool sink_done(const t_sink *sink, const t_mode mode) {
+  return (mode == MODE_FIRST && sink->count >= 1) ||
+         (sink->limit > 0 && sink->count >= sink->limit) ||
+         (sink->max_nodes > 0 && sink->nodes >= sink->max_nodes);
+}
+
+// Hands a solution found by the search to the sink
+void sink_emit(t_sink *sink, const t_grid *solution) {
+  sink->count++;
+  if (sink->callback != NULL) {
+    sink->callback(solution, sink->data);
   }
+}
 
-  t_grid **solutions = malloc(sizeof(t_grid *));
-  int nb_solutions = 0;
-  int nb_solutions_found = 0;
+void free_solutions(t_solutions *solutions) {
+  for (int i = 0; i < solutions->count; i++) {
+    grid_free(solutions->grids[i]);
+    free(solutions->grids[i]);
+  }
+  free(solutions->grids);
+  solutions->grids = NULL;
+  solutions->count = 0;
+  solutions->capacity = 0;
+}
 
-  t_grid *grid_tmp = malloc(sizeof(t_grid));
-  grid_allocate(grid_tmp, grid->size);
-  grid_copy(grid, grid_tmp);
+// Hands the solutions of a consistent grid to the sink with the engine of the
+// context options. Returns the number of solutions found (at most one in
+// MODE_FIRST, at most the limit of the sink if it has one), errors are left
+// in the context.
+long grid_solver(tkz_context *ctx, t_grid *grid, t_sink *sink,
+                 const t_mode mode) {
+  const tkz_options *opts = &ctx->options;
+  if (is_grid_full(grid)) {
+    if (ctx->log != NULL) {
+      fprintf(ctx->log, "Starting grid is already completed\n");
+    }
+    sink_emit(sink, grid);
+    return 1;
+  }
 
-  nb_solutions_found =
-      grid_solver_recursive(grid_tmp, solutions, &nb_solutions, mode);
+  if (opts->engine == ENGINE_CDCL) {
+    return grid_solver_cdcl(ctx, grid, sink, mode);
+  } else if (opts->engine == ENGINE_SAT) {
+    return grid_solver_sat(ctx, grid, sink, mode, opts->sat_solver);
+  } else if (opts->threads > 1) {
+    return grid_solver_parallel(ctx, grid, sink, mode, opts->threads);
+  } else if (sink->callback == NULL && opts->symmetry && mode == MODE_ALL) {
+    // an orbit counts for several solutions, MODE_FIRST wants only one
+    return grid_solver_symmetric(ctx, grid, sink, mode);
+  }
+  return grid_solver_trail(ctx, grid, sink, mode);
+}
 
-  if (nb_solutions_found == 0) {
-    fprintf(sw.output_file, "Number of solutions: 0\n");
-    free_solutions(solutions, nb_solutions);
-    return false;
+// Adds solutions that are not visited (subtree found in the transposition
+// table, orbit of a symmetric solution) to the sink, up to its limit (one
+// solution in MODE_FIRST)
+static long replay_count(t_sink *sink, long count, const t_mode mode) {
+  long limit = mode == MODE_FIRST ? 1 : sink->limit;
+  if (limit > 0 && sink->count + count > limit) {
+    count = limit - sink->count;
   }
+  sink->count += count;
+  return count;
+}
 
-  // I prefer handling it all here instead of both the main and here
-  if (mode == MODE_FIRST) {
-    fprintf(sw.output_file, "Number of solutions: 1\n");
-    fprintf(sw.output_file, "Solution 1\n");
-    fprintf(sw.output_file, "Grid for solution 1:\n");
-    grid_print(solutions[0], sw.output_file);
-    return true;
-  } else if (mode == MODE_ALL) {
-    fprintf(sw.output_file, "Number of solutions: %d\n", nb_solutions_found);
-    for (int i = 0; i < nb_solutions_found; i++) {
-      fprintf(sw.output_file, "Solution %d\n", i + 1);
-      fprintf(sw.output_file, "Grid for solution %d:\n", i + 1);
-      grid_print(solutions[i], sw.output_file);
+// First empty cell in row-major order. Branching in the order of the
+// lex-leader comparisons decides them as early as possible.
+static choice_t first_empty_cell(const t_grid *grid) {
+  choice_t choice = {0, 0, '0'};
+  uint64_t mask = line_mask(grid->size);
+  for (int i = 0; i < grid->size; i++) {
+    uint64_t empty = mask & ~(grid->rows[0][i] | grid->rows[1][i]);
+    if (empty != 0) {
+      choice.row = i;
+      choice.column = __builtin_ctzll(empty);
+      break;
     }
-    return true;
   }
-  // failsafe
-  return false;
+  return choice;
 }
 
-int grid_solver_recursive(t_grid *grid, t_grid **solutions, int *nb_solutions,
-                          const t_mode mode) {
-  if (mode == MODE_FIRST && *nb_solutions == 1) {
-    return 1;
+// Search of grid_solver_recursive.
+// With symmetries (only when the sink counts), the search only accepts the
+// solutions that are the smallest of their orbit under the symmetries, each
+// one counting for its whole orbit.
+static long search(tkz_context *ctx, t_grid *grid, t_sink *sink,
+                   const t_mode mode, const t_symmetries *symmetries) {
+  if (sink_done(sink, mode)) {
+    return 0;
   }
+  sink->nodes++;
 
-  if (!is_consistent(grid)) {
+  // Conflicts are detected while propagating, a grid that is full at this
+  // point is therefore valid
+  if (!grid_propagate(ctx, grid)) {
     return 0;
   }
 
-  if (is_valid(grid)) {
-    add_solution(grid, solutions, nb_solutions);
+  if (is_grid_full(grid)) {
+    if (symmetries != NULL) {
+      return replay_count(sink, symmetries_weight(grid, symmetries), mode);
+    }
+    sink_emit(sink, grid);
     return 1;
   }
 
-  apply_heuristics(grid);
-
-  if (!is_consistent(grid)) {
+  if (symmetries != NULL && !symmetries_may_lead(grid, symmetries)) {
     return 0;
   }
 
-  if (is_valid(grid)) {
-    add_solution(grid, solutions, nb_solutions);
-    return 1;
+  // Both branches are explored on the same grid, everything set below this
+  // point (the choice and what the heuristics deduce from it) is rolled back
+  // before trying the other value
+  long nb_solutions_local = 0;
+  choice_t choice = symmetries != NULL ? first_empty_cell(grid)
+                                       : grid_choice(ctx, grid,
+                                                     ctx->options.branching,
+                                                     ctx->rng);
+  int mark = trail_mark(grid);
+
+  grid_choice_apply(ctx, grid, choice);
+  nb_solutions_local += search(ctx, grid, sink, mode, symmetries);
+  trail_undo(grid, mark);
+
+  if (sink_done(sink, mode)) {
+    return nb_solutions_local;
+  }
+
+  choice.choice = choice.choice == '0' ? '1' : '0';  // invert choice
+  grid_choice_apply(ctx, grid, choice);
+  nb_solutions_local += search(ctx, grid, sink, mode, symmetries);
+  trail_undo(grid, mark);
+  return nb_solutions_local;
+}
+
+// Runs grid_solver_recursive on a working copy of grid with its own undo
+// trail, the only allocation done for the whole search
+long grid_solver_trail(tkz_context *ctx, t_grid *grid, t_sink *sink,
+                       const t_mode mode) {
+  t_grid work;
+  t_trail trail;
+  grid_copy(grid, &work);
+  if (!trail_init(&trail, grid->size)) {
+    context_fail(ctx, TKZ_ERROR_MEMORY, "could not allocate the undo trail");
+    return 0;
   }
+  work.trail = &trail;
+  // Every line has to be examined once before the first choice
+  work.queue_rows = line_mask(grid->size);
+  work.queue_cols = line_mask(grid->size);
 
-  t_grid grid_1, grid_2;
-  grid_copy(grid, &grid_1);
-  grid_copy(grid, &grid_2);
+  long nb_solutions_found = search(ctx, &work, sink, mode, NULL);
 
-  int nb_solutions_local = 0;
-  choice_t choice = grid_choice(grid);
+  trail_free(&trail);
+  return nb_solutions_found;
+}
 
-  grid_choice_apply(&grid_1, choice);
-  nb_solutions_local +=
-      grid_solver_recursive(&grid_1, solutions, nb_solutions, mode);
-  grid_choice_remove(&grid_1, choice);
-  grid_free(&grid_1);
+long grid_solver_recursive(tkz_context *ctx, t_grid *grid, t_sink *sink,
+                           const t_mode mode) {
+  return search(ctx, grid, sink, mode, NULL);
+}
 
-  if (nb_solutions_local > 0 && mode == MODE_FIRST) {
-    return nb_solutions_local;
+// Counts the solutions of grid (the sink must not have a callback) visiting
+// only one solution per orbit under the symmetries of the rules that also
+// leave the given cells unchanged, see symmetry.c
+long grid_solver_symmetric(tkz_context *ctx, t_grid *grid, t_sink *sink,
+                           const t_mode mode) {
+  t_symmetries symmetries;
+  symmetries_detect(grid, &symmetries);
+  if (ctx->log != NULL) {
+    fprintf(ctx->log, "Symmetries of the grid: %d\n", symmetries.count);
   }
 
-  choice.choice = choice.choice == '0' ? '1' : '0';  // invert choice
-  grid_choice_apply(&grid_2, choice);
-  nb_solutions_local +=
-      grid_solver_recursive(&grid_2, solutions, nb_solutions, mode);
-  grid_choice_remove(&grid_2, choice);
-  grid_free(&grid_2);
+  t_grid work;
+  t_trail trail;
+  grid_copy(grid, &work);
+  if (!trail_init(&trail, grid->size)) {
+    context_fail(ctx, TKZ_ERROR_MEMORY, "could not allocate the undo trail");
+    return 0;
+  }
+  work.trail = &trail;
+  work.queue_rows = line_mask(grid->size);
+  work.queue_cols = line_mask(grid->size);
 
-  return nb_solutions_local;
+  long nb_solutions_found = search(ctx, &work, sink, mode,
+                                   symmetries.count > 1 ? &symmetries : NULL);
+
+  trail_free(&trail);
+  return nb_solutions_found;
 }
 
-// Heuristic 1 : If a row (respectively column) has two consecutive
-// zeroes, the cells before/after must be ones. The same heuristics
-// applies to ones as well.
-bool apply_heuristic1(t_grid *g) {
-  if (sw.verbose) {
-    fprintf(sw.output_file, "Applying heuristic 1...\n");
+// Sets every cell of row i whose bit is set in `cells` to v
+static void fill_row(tkz_context *ctx, t_grid *g, int i, uint64_t cells,
+                     char v) {
+  while (cells) {
+    int j = __builtin_ctzll(cells);
+    cells &= cells - 1;
+    if (ctx->log != NULL) {
+      fprintf(ctx->log, "Cell (%d, %d) => %c\n", i, j, v);
+    }
+    set_cell(i, j, g, v);
   }
+}
+
+// Sets every cell of column j whose bit is set in `cells` to v
+static void fill_col(tkz_context *ctx, t_grid *g, int j, uint64_t cells,
+                     char v) {
+  while (cells) {
+    int i = __builtin_ctzll(cells);
+    cells &= cells - 1;
+    if (ctx->log != NULL) {
+      fprintf(ctx->log, "Cell (%d, %d) => %c\n", i, j, v);
+    }
+    set_cell(i, j, g, v);
+  }
+}
 
-  bool changed = false;
-  changed = sub_heuristic1_rows(g) || changed;
-  changed = sub_heuristic1_cols(g) || changed;
+// Empty cells of a line that would complete a run of three cells set in `m`,
+// for the whole line at once: right after a pair (mm_), right before a pair
+// (_mm) and in the middle of a sandwich (m_m)
+static uint64_t run_breakers(uint64_t m, uint64_t empty) {
+  uint64_t pairs = m & (m >> 1);           // bit k set if k and k + 1 are set
+  uint64_t sandwiches = (m << 1) & (m >> 1);  // k - 1 and k + 1 are set
+  return ((pairs << 2) | (pairs >> 1) | sandwiches) & empty;
+}
 
-  if (sw.verbose && changed) {
-    fprintf(sw.output_file, "Heuristic 1 has modified the grid\n");
+// Heuristic 1 : If a line has two consecutive zeroes, the cells before/after
+// must be ones, and a cell between two zeroes must be a one. The same
+// heuristics applies to ones as well.
+// Heuristic 2 : If a line has all its zeros filled, the remaining empty cells
+// are ones. The same heuristics applies to ones.
+// Computes the cells of a line forced by both heuristics, returns false if a
+// cell would have to be both a zero and a one
+static bool line_heuristics(uint64_t zeros, uint64_t ones, int size,
+                            uint64_t *to_zero, uint64_t *to_one) {
+  uint64_t empty = ~(zeros | ones) & line_mask(size);
+  *to_one = run_breakers(zeros, empty);
+  *to_zero = run_breakers(ones, empty);
+  if (__builtin_popcountll(zeros) == size / 2) {
+    *to_one |= empty;
+  }
+  if (__builtin_popcountll(ones) == size / 2) {
+    *to_zero |= empty;
   }
-  return changed;
+  return (*to_zero & *to_one) == 0;
 }
 
-bool sub_heuristic1_rows(t_grid *g) {
-  bool changed = false;
-  for (int i = 0; i < g->size; i++) {
-    for (int j = 0; j < g->size - 2; j++) {
-      // if two consecutive zeros
-      if (get_cell(i, j, g) == '0' && get_cell(i, j + 1, g) == '0') {
-        // if the cell after is empty, we fill it with a one
-        if (get_cell(i, j + 2, g) == '_') {
-          if (sw.verbose) {
-            fprintf(sw.output_file, "Cell (%d, %d) => 1\n", i, j + 2);
-          }
-          set_cell(i, j + 2, g, '1');
-          changed = true;
-        }  // if the cell before is empty, we fill it with a one
-        else if (j > 0 && get_cell(i, j - 1, g) == '_') {
-          if (sw.verbose) {
-            fprintf(sw.output_file, "Cell (%d, %d) => 1\n", i, j - 1);
-          }
-          set_cell(i, j - 1, g, '1');
-          changed = true;
-        }
-      }
-      // same thing for ones
-      else if (get_cell(i, j, g) == '1' && get_cell(i, j + 1, g) == '1') {
-        // if the cell after is empty, we fill it with a zero
-        if (get_cell(i, j + 2, g) == '_') {
-          if (sw.verbose) {
-            fprintf(sw.output_file, "Cell (%d, %d) => 0\n", i, j + 2);
-          }
-          set_cell(i, j + 2, g, '0');
-          changed = true;
-        }  // if the cell before is empty, we fill it with a zero
-        else if (j > 0 && get_cell(i, j - 1, g) == '_') {
-          if (sw.verbose) {
-            fprintf(sw.output_file, "Cell (%d, %d) => 0\n", i, j - 1);
-          }
-          set_cell(i, j - 1, g, '0');
-          changed = true;
-        }
-      }
+// A line one or two cells away from being full has at most two balanced
+// completions, the ones identical to a full line of the same direction are
+// ruled out. Adds the cells this forces to to_zero/to_one, returns false if
+// every completion is ruled out.
+static bool line_unique_completion(const t_line_set *full, uint64_t zeros,
+                                   uint64_t ones, int size, uint64_t *to_zero,
+                                   uint64_t *to_one) {
+  uint64_t empty = ~(zeros | ones | *to_zero | *to_one) & line_mask(size);
+  int nb_empty = __builtin_popcountll(empty);
+  int need_ones = size / 2 - __builtin_popcountll(ones | *to_one);
+  if (nb_empty == 0 || nb_empty > 2 || need_ones < 0 || need_ones > nb_empty) {
+    return true;
+  }
+
+  ones |= *to_one;
+  if (nb_empty == 2 && need_ones == 1) {
+    uint64_t first = empty & -empty;
+    uint64_t second = empty & ~first;
+    bool first_taken = line_set_count(full, ones | first) > 0;
+    bool second_taken = line_set_count(full, ones | second) > 0;
+    if (first_taken && second_taken) {
+      return false;
+    }
+    if (first_taken) {
+      *to_one |= second;
+      *to_zero |= first;
+    } else if (second_taken) {
+      *to_one |= first;
+      *to_zero |= second;
     }
+    return true;
   }
-  return changed;
+  // a single balanced completion
+  return line_set_count(full, need_ones ? ones | empty : ones) == 0;
 }
 
-bool sub_heuristic1_cols(t_grid *g) {
-  bool changed = false;
-  for (int j = 0; j < g->size; j++) {
-    for (int i = 0; i < g->size - 2; i++) {
-      // if two consecutive zeros
-      if (get_cell(i, j, g) == '0' && get_cell(i + 1, j, g) == '0') {
-        // if the cell after is empty, we fill it with a one
-        if (get_cell(i + 2, j, g) == '_') {
-          if (sw.verbose) {
-            fprintf(sw.output_file, "Cell (%d, %d) => 1\n", i + 2, j);
-          }
-          set_cell(i + 2, j, g, '1');
-          changed = true;
-        }  // if the cell before is empty, we fill it with a one
-        else if (i > 0 && get_cell(i - 1, j, g) == '_') {
-          if (sw.verbose) {
-            fprintf(sw.output_file, "Cell (%d, %d) => 1\n", i - 1, j);
-          }
-          set_cell(i - 1, j, g, '1');
-          changed = true;
-        }
-      }
-      // same thing for ones
-      else if (get_cell(i, j, g) == '1' && get_cell(i + 1, j, g) == '1') {
-        // if the cell after is empty, we fill it with a zero
-        if (get_cell(i + 2, j, g) == '_') {
-          if (sw.verbose) {
-            fprintf(sw.output_file, "Cell (%d, %d) => 0\n", i + 2, j);
-          }
-          set_cell(i + 2, j, g, '0');
-          changed = true;
-        }  // if the cell before is empty, we fill it with a zero
-        else if (i > 0 && get_cell(i - 1, j, g) == '_') {
-          if (sw.verbose) {
-            fprintf(sw.output_file, "Cell (%d, %d) => 0\n", i - 1, j);
-          }
-          set_cell(i - 1, j, g, '0');
-          changed = true;
-        }
-      }
+// Cells of line `index` of a direction (g->rows or g->cols, whose full lines
+// are in `full`) forced by the other cells of the line. Up to
+// PATTERNS_MAX_SIZE the domain of the line (the valid lines still compatible
+// with it and different from the full lines of the same direction) is
+// computed from the pattern table, which subsumes both heuristics. Larger
+// lines fall back to the heuristics, plus the duplicate check of the lines
+// that are almost full.
+// Returns false if the line can't be completed.
+static bool line_forced(const t_grid *g, uint64_t lines[2][MAX_GRID_SIZE],
+                        const t_line_set *full, int index, uint64_t *to_zero,
+                        uint64_t *to_one) {
+  uint64_t zeros = lines[0][index];
+  uint64_t ones = lines[1][index];
+  const t_patterns *patterns = patterns_get(g->size);
+  if (patterns == NULL) {
+    return line_heuristics(zeros, ones, g->size, to_zero, to_one) &&
+           line_unique_completion(full, zeros, ones, g->size, to_zero, to_one);
+  }
+
+  uint64_t domain[PATTERNS_MAX_WORDS];
+  patterns_domain(patterns, zeros, ones, domain);
+  for (int k = 0; k < g->size; k++) {
+    if (k != index && (lines[0][k] | lines[1][k]) == line_mask(g->size)) {
+      patterns_exclude(patterns, lines[1][k], domain);
     }
   }
-  return changed;
+  if (!patterns_forced(patterns, domain, to_zero, to_one)) {
+    return false;
+  }
+  uint64_t empty = ~(zeros | ones) & line_mask(g->size);
+  *to_zero &= empty;
+  *to_one &= empty;
+  return true;
 }
 
-// Heuristic 2 : If a row (respectively column) has all its zeros
-// filled, the remaining empty cells are ones. The same heuristics
-// applies to ones
-bool apply_heuristic2(t_grid *g) {
-  if (sw.verbose) {
-    fprintf(sw.output_file, "Applying heuristic 2...\n");
+// Examines row i after one of its cells has been set: the row must still be
+// consistent, and the cells it forces are filled (which enqueues their
+// columns). Returns false on a conflict.
+bool propagate_row(tkz_context *ctx, t_grid *g, int i) {
+  uint64_t zeros = g->rows[0][i];
+  uint64_t ones = g->rows[1][i];
+  if (!is_line_consistent(zeros, ones, g->size)) {
+    return false;
   }
-  bool changed = false;
+  if (is_row_full(i, g)) {
+    return line_set_count(&g->full_rows, ones) == 1;
+  }
+
+  uint64_t to_zero, to_one;
+  if (!line_forced(g, g->rows, &g->full_rows, i, &to_zero, &to_one)) {
+    return false;
+  }
+  fill_row(ctx, g, i, to_one, '1');
+  fill_row(ctx, g, i, to_zero, '0');
+  return true;
+}
 
-  changed = sub_heuristic2_rows(g) || changed;
-  changed = sub_heuristic2_cols(g) || changed;
+bool propagate_col(tkz_context *ctx, t_grid *g, int j) {
+  uint64_t zeros = g->cols[0][j];
+  uint64_t ones = g->cols[1][j];
+  if (!is_line_consistent(zeros, ones, g->size)) {
+    return false;
+  }
+  if (is_col_full(j, g)) {
+    return line_set_count(&g->full_cols, ones) == 1;
+  }
 
-  if (sw.verbose && changed) {
-    fprintf(sw.output_file, "Heuristic 2 applied\n");
+  uint64_t to_zero, to_one;
+  if (!line_forced(g, g->cols, &g->full_cols, j, &to_zero, &to_one)) {
+    return false;
   }
-  return changed;
+  fill_col(ctx, g, j, to_one, '1');
+  fill_col(ctx, g, j, to_zero, '0');
+  return true;
 }
-// If a row(respectively column) has all its zeros filled,
-//     the remaining empty cells are ones.The same
-//     heuristics applies to ones.
-bool sub_heuristic2_rows(t_grid *g) {
-  bool changed = false;
-  for (int i = 0; i < g->size; i++) {
-    int zeros = 0;
-    int ones = 0;
-    for (int j = 0; j < g->size; j++) {
-      if (get_cell(i, j, g) == '0') {
-        zeros++;
-      } else if (get_cell(i, j, g) == '1') {
-        ones++;
-      }
+
+// Applies the heuristics until nothing changes. Only the lines that have been
+// modified since the last call (the ones queued by set_cell) are examined,
+// and every cell filled queues its row and column in turn.
+// Returns false as soon as a line is found inconsistent, the queue is then
+// emptied as the grid is going to be rolled back by the caller.
+bool apply_heuristics(tkz_context *ctx, t_grid *g) {
+  if (ctx->log != NULL) {
+    fprintf(ctx->log, "Applying heuristics...\n");
+  }
+
+  while (g->queue_rows | g->queue_cols) {
+    bool consistent;
+    if (g->queue_rows) {
+      int i = __builtin_ctzll(g->queue_rows);
+      g->queue_rows &= g->queue_rows - 1;
+      consistent = propagate_row(ctx, g, i);
+    } else {
+      int j = __builtin_ctzll(g->queue_cols);
+      g->queue_cols &= g->queue_cols - 1;
+      consistent = propagate_col(ctx, g, j);
     }
-    if (zeros == g->size / 2) {
-      for (int j = 0; j < g->size; j++) {
-        if (get_cell(i, j, g) == '_') {
-          if (sw.verbose) {
-            fprintf(sw.output_file, "Cell (%d, %d) => 1\n", i, j);
-          }
-          set_cell(i, j, g, '1');
-          changed = true;
-        }
-      }
-    } else if (ones == g->size / 2) {
-      for (int j = 0; j < g->size; j++) {
-        if (get_cell(i, j, g) == '_') {
-          if (sw.verbose) {
-            fprintf(sw.output_file, "Cell (%d, %d) => 0\n", i, j);
-          }
-          set_cell(i, j, g, '0');
-          changed = true;
-        }
+
+    if (!consistent) {
+      if (ctx->log != NULL) {
+        fprintf(ctx->log, "Heuristics found a contradiction\n");
       }
+      g->queue_rows = 0;
+      g->queue_cols = 0;
+      return false;
     }
   }
-  return changed;
+
+  if (ctx->log != NULL) {
+    fprintf(ctx->log, "New grid :\n");
+    grid_print(g, ctx->log);
+  }
+  return true;
 }
 
-bool sub_heuristic2_cols(t_grid *g) {
-  bool changed = false;
-  for (int j = 0; j < g->size; j++) {
-    int zeros = 0;
-    int ones = 0;
+// true if setting (i, j) = v leads to a contradiction: right away with the
+// heuristics, or when level is 2 through a level 1 lookahead on the result.
+// The grid is left untouched.
+static bool probe_fails(tkz_context *ctx, t_grid *g, int i, int j, char v,
+                        int level) {
+  int mark = trail_mark(g);
+  set_cell(i, j, g, v);
+  bool failed = !apply_heuristics(ctx, g) ||
+                (level > 1 && !apply_lookahead(ctx, g, level - 1));
+  trail_undo(g, mark);
+  return failed;
+}
+
+// Failed literal probing: every value of every empty cell is tried and
+// propagated, then rolled back. When a value leads to a contradiction the
+// cell must hold the other one, which is set (and propagated) without
+// branching. Repeated until no probe fails anymore. Level 2 (double
+// lookahead) probes with a level 1 lookahead instead of the heuristics only.
+// Returns false if the grid has no solution.
+bool apply_lookahead(tkz_context *ctx, t_grid *g, int level) {
+  bool changed = level > 0;
+  while (changed) {
+    changed = false;
     for (int i = 0; i < g->size; i++) {
-      if (get_cell(i, j, g) == '0') {
-        zeros++;
-      } else if (get_cell(i, j, g) == '1') {
-        ones++;
-      }
-    }
-    if (zeros == g->size / 2) {
-      for (int i = 0; i < g->size; i++) {
-        if (get_cell(i, j, g) == '_') {
-          if (sw.verbose) {
-            fprintf(sw.output_file, "Cell (%d, %d) => 1\n", i, j);
-          }
-          set_cell(i, j, g, '1');
-          changed = true;
+      for (uint64_t e = row_empty_cells(g, i); e; e &= e - 1) {
+        int j = __builtin_ctzll(e);
+        // an earlier deduction may have filled it
+        if (get_cell(i, j, g) != '_') {
+          continue;
         }
-      }
-    } else if (ones == g->size / 2) {
-      for (int i = 0; i < g->size; i++) {
-        if (get_cell(i, j, g) == '_') {
-          if (sw.verbose) {
-            fprintf(sw.output_file, "Cell (%d, %d) => 0\n", i, j);
+        for (char v = '0'; v <= '1'; v++) {
+          if (!probe_fails(ctx, g, i, j, v, level)) {
+            continue;
+          }
+          char forced = v == '0' ? '1' : '0';
+          if (ctx->log != NULL) {
+            fprintf(ctx->log, "Lookahead: cell (%d, %d) => %c\n", i, j,
+                    forced);
+          }
+          set_cell(i, j, g, forced);
+          if (!apply_heuristics(ctx, g)) {
+            return false;
           }
-          set_cell(i, j, g, '0');
           changed = true;
+          break;
         }
       }
     }
   }
-  return changed;
+  return true;
 }
 
-void apply_heuristics(t_grid *g) {
-  if (sw.verbose) {
-    fprintf(sw.output_file, "Applying heuristics...\n");
-  }
-  // apply heuristics until guess are exhausted
+// Everything the solver deduces at a node before branching: the heuristics,
+// then the lookahead of the level asked for
+bool grid_propagate(tkz_context *ctx, t_grid *g) {
+  return apply_heuristics(ctx, g) &&
+         apply_lookahead(ctx, g, ctx->options.lookahead);
+}
 
-  while (apply_heuristic1(g) || apply_heuristic2(g)) {
-    if (sw.verbose) {
-      fprintf(sw.output_file, "New grid :\n");
-      grid_print(g, sw.output_file);
-    }
+// Nodes the search deciding whether a cell can be removed from a generated
+// grid may visit. A search that needs more keeps the cell: the grid has a few
+// more cells than it could, but the time of a removal is bounded.
+#define GENERATOR_MAX_NODES 256
+
+// Random permutation of the cells of a grid of the given size, as indexes
+// i * size + j
+static void shuffle_cells(tkz_context *ctx, int *cells, int size) {
+  int nb_cells = size * size;
+  for (int k = 0; k < nb_cells; k++) {
+    cells[k] = k;
+  }
+  for (int k = nb_cells - 1; k > 0; k--) {
+    int other = rng_below(ctx->rng, k + 1);
+    int tmp = cells[k];
+    cells[k] = cells[other];
+    cells[other] = tmp;
   }
 }
 
-void generate_grid(t_grid *g, int percentage_fill) {
-  if (sw.verbose) {
-    fprintf(sw.output_file, "Generating grid of size %d\n", g->size);
+// Completes g into a random valid grid: the conflict-driven engine with
+// random decisions finds a solution quickly even for an empty 64x64 grid,
+// where the random backtracking search gets lost. Returns false on an error,
+// left in the context.
+static bool random_solution(tkz_context *ctx, t_grid *g) {
+  t_solutions solutions = {NULL, 0, 0};
+  t_sink sink = {collect_solution, &solutions, 0, 1};
+  tkz_options saved = ctx->options;
+  ctx->options.branching = BRANCH_RANDOM;
+  grid_solver_cdcl(ctx, g, &sink, MODE_FIRST);
+  ctx->options = saved;
+
+  if (ctx->status == TKZ_OK && solutions.count == 0) {
+    context_fail(ctx, sink.count == 0 ? TKZ_ERROR_INCONSISTENT
+                                      : TKZ_ERROR_MEMORY,
+                 "could not complete the grid");
   }
-  // get the number of cells to fill from percentage
-  int cells_fill = (((g->size * g->size) * percentage_fill) / 100);
-  // fill the grid with n 0 and 1 at random
-  while (cells_fill > 0) {
-    choice_t choice = grid_choice(g);
-    grid_choice_apply(g, choice);
-    cells_fill--;
+  if (ctx->status == TKZ_OK) {
+    grid_copy(solutions.grids[0], g);
   }
+  free_solutions(&solutions);
+  return ctx->status == TKZ_OK;
+}
 
-  if (!is_consistent(g)) {
-    generate_grid(g, percentage_fill);
-  }
+// Number of cells percentage_fill percent of the grid holds
+static int cells_from_percentage(const t_grid *g, int percentage_fill) {
+  return g->size * g->size * percentage_fill / 100;
 }
 
-t_grid *generate_unique_grid(t_grid *grid, int percentage_fill) {
-  generate_grid(grid, percentage_fill);
+// Fills g with percentage_fill percent of the cells of a random valid grid,
+// which therefore has at least one solution
+void generate_grid(tkz_context *ctx, t_grid *g, int percentage_fill) {
+  if (ctx->log != NULL) {
+    fprintf(ctx->log, "Generating grid of size %d\n", g->size);
+  }
+  if (!random_solution(ctx, g)) {
+    return;
+  }
 
-  t_grid **solutions = malloc(sizeof(t_grid *));
-  int nb_solutions = 0;
+  int cells[MAX_GRID_SIZE * MAX_GRID_SIZE];
+  shuffle_cells(ctx, cells, g->size);
+  int nb_removed = g->size * g->size - cells_from_percentage(g, percentage_fill);
+  for (int k = 0; k < nb_removed; k++) {
+    set_cell(cells[k] / g->size, cells[k] % g->size, g, '_');
+  }
+}
 
-  t_grid *grid_tmp = malloc(sizeof(t_grid));
-  grid_allocate(grid_tmp, grid->size);
-  grid_copy(grid, grid_tmp);
+// true if the grid, which has a unique solution holding v at (i, j), still
+// has a unique solution without that cell: no solution may hold the other
+// value there. Most of the time the heuristics find it contradictory at once,
+// otherwise the search decides it within GENERATOR_MAX_NODES nodes or the
+// cell is considered needed.
+static bool is_cell_removable(tkz_context *ctx, const t_grid *grid, int i,
+                              int j, char v) {
+  t_grid other;
+  grid_copy(grid, &other);
+  set_cell(i, j, &other, '_');
+  set_cell(i, j, &other, v == '0' ? '1' : '0');
+  if (!is_consistent(&other)) {
+    return true;
+  }
+  t_sink sink = {NULL, NULL, 0, 1, GENERATOR_MAX_NODES, 0};
+  long nb_solutions = grid_solver_trail(ctx, &other, &sink, MODE_FIRST);
+  return nb_solutions == 0 && sink.nodes < GENERATOR_MAX_NODES;
+}
 
-  grid_solver_recursive(grid_tmp, solutions, &nb_solutions, MODE_ALL);
+// Builds a random valid grid, then removes its cells in a random order down
+// to percentage_fill percent of the grid, keeping only the removals after
+// which the grid still has exactly one solution. Each removal costs one
+// bounded search and nothing is ever started over: the time only depends on
+// the size. The grid may keep more cells than asked for, when none of them
+// can be removed. Returns false on an error, left in the context.
+bool generate_unique_grid(tkz_context *ctx, t_grid *grid,
+                          int percentage_fill) {
+  if (ctx->log != NULL) {
+    fprintf(ctx->log, "Generating grid of size %d\n", grid->size);
+  }
+  if (!random_solution(ctx, grid)) {
+    return false;
+  }
 
-  if (nb_solutions == 1) {
-    free_solutions(solutions, nb_solutions);
-    return grid;
-  } else {
-    free_solutions(solutions, nb_solutions);
-    return generate_unique_grid(grid, percentage_fill);
+  int cells[MAX_GRID_SIZE * MAX_GRID_SIZE];
+  shuffle_cells(ctx, cells, grid->size);
+  int nb_cells = grid->size * grid->size;
+  int target = cells_from_percentage(grid, percentage_fill);
+  for (int k = 0; k < grid->size * grid->size && nb_cells > target &&
+                  ctx->status == TKZ_OK;
+       k++) {
+    int i = cells[k] / grid->size;
+    int j = cells[k] % grid->size;
+    char v = get_cell(i, j, grid);
+    if (is_cell_removable(ctx, grid, i, j, v)) {
+      set_cell(i, j, grid, '_');
+      nb_cells--;
+    }
   }
-}
\ No newline at end of file
+  if (ctx->log != NULL) {
+    fprintf(ctx->log, "Cells kept: %d (%d asked for)\n", nb_cells, target);
+  }
+  return ctx->status == TKZ_OK;
+}
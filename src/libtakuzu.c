@@ -0,0 +1,471 @@
+#include "libtakuzu.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cnf.h"
+#include "grid.h"
+#include "rng.h"
+
+// Records the first error of a call, the ones that follow from it are not
+// as informative
+void context_fail(tkz_context *ctx, tkz_status status, const char *format,
+                  ...) {
+  if (ctx->status != TKZ_OK) {
+    return;
+  }
+  ctx->status = status;
+  va_list args;
+  va_start(args, format);
+  vsnprintf(ctx->message, sizeof(ctx->message), format, args);
+  va_end(args);
+}
+
+void tkz_options_init(tkz_options *opts) {
+  opts->engine = ENGINE_BACKTRACK;
+  opts->branching = BRANCH_LINE;
+  opts->mode = MODE_FIRST;
+  opts->limit = 0;
+  opts->threads = 1;
+  opts->lookahead = 0;
+  opts->symmetry = true;
+  opts->sat_solver = NULL;
+}
+
+void tkz_context_init(tkz_context *ctx) {
+  tkz_options_init(&ctx->options);
+  ctx->log = NULL;
+  ctx->status = TKZ_OK;
+  ctx->message[0] = '\0';
+  ctx->nb_solutions = 0;
+  ctx->nb_nodes = 0;
+  tkz_context_seed(ctx, 0, 0);
+}
+
+// The random choices of the calls made with ctx (generated grids, random
+// branching) follow from seed and stream only: the same seed gives the same
+// grids and the same search, and the streams of a seed give independent
+// sequences, one per thread or per grid
+void tkz_context_seed(tkz_context *ctx, uint64_t seed, uint64_t stream) {
+  rng_seed(ctx->rng, seed, stream);
+}
+
+const char *tkz_strerror(tkz_status status) {
+  switch (status) {
+    case TKZ_OK:
+      return "no error";
+    case TKZ_ERROR_SIZE:
+      return "invalid grid size";
+    case TKZ_ERROR_CHARACTER:
+      return "invalid character";
+    case TKZ_ERROR_SHAPE:
+      return "inconsistent number of char by row";
+    case TKZ_ERROR_EMPTY:
+      return "empty file";
+    case TKZ_ERROR_INCONSISTENT:
+      return "the starting grid is inconsistent";
+    case TKZ_ERROR_ARGUMENT:
+      return "invalid argument";
+    case TKZ_ERROR_MEMORY:
+      return "out of memory";
+    case TKZ_ERROR_IO:
+      return "input/output error";
+    case TKZ_ERROR_SAT_SOLVER:
+      return "SAT solver failure";
+    case TKZ_ERROR_THREAD:
+      return "could not start a solver thread";
+  }
+  return "unknown error";
+}
+
+// Every call starts with a clean status
+void context_reset(tkz_context *ctx) {
+  ctx->status = TKZ_OK;
+  ctx->message[0] = '\0';
+}
+
+static bool check_options(tkz_context *ctx, const tkz_options *opts) {
+  if (opts->threads < 1) {
+    context_fail(ctx, TKZ_ERROR_ARGUMENT, "invalid number of threads %d",
+                 opts->threads);
+  } else if (opts->lookahead < 0 || opts->lookahead > 2) {
+    context_fail(ctx, TKZ_ERROR_ARGUMENT, "invalid lookahead level %d",
+                 opts->lookahead);
+  } else if (opts->limit < 0) {
+    context_fail(ctx, TKZ_ERROR_ARGUMENT, "invalid solution limit %ld",
+                 opts->limit);
+  } else if (opts->engine != ENGINE_BACKTRACK && opts->threads > 1) {
+    context_fail(ctx, TKZ_ERROR_ARGUMENT,
+                 "only the backtracking engine runs on several threads");
+  }
+  return ctx->status == TKZ_OK;
+}
+
+// true for the sizes a grid can have: 4, 8, 16, 32 and 64
+bool tkz_valid_size(int size) {
+  return size == 4 || size == 8 || size == 16 || size == 32 || size == 64;
+}
+
+// Initializes an empty grid of the given size
+tkz_status tkz_grid_init(tkz_context *ctx, t_grid *grid, int size) {
+  context_reset(ctx);
+  if (!tkz_valid_size(size)) {
+    context_fail(ctx, TKZ_ERROR_SIZE,
+                 "Invalid size, %d is not in the valid sizes %d, %d, %d, %d, "
+                 "%d!",
+                 size, 4, 8, 16, 32, 64);
+    return ctx->status;
+  }
+  grid_allocate(grid, size);
+  return TKZ_OK;
+}
+
+tkz_status tkz_grid_set(tkz_context *ctx, t_grid *grid, int i, int j,
+                        char v) {
+  context_reset(ctx);
+  if (!check_char(v)) {
+    context_fail(ctx, TKZ_ERROR_CHARACTER,
+                 "tried to insert an invalid character ('%c') in a grid", v);
+  } else if (i < 0 || i >= grid->size || j < 0 || j >= grid->size) {
+    context_fail(ctx, TKZ_ERROR_ARGUMENT,
+                 "tried to insert a cell out of bounds (%d, %d) in a grid of "
+                 "size %d",
+                 i, j, grid->size);
+  } else {
+    set_cell(i, j, grid, v);
+  }
+  return ctx->status;
+}
+
+// '0', '1' or '_', '\0' if (i, j) is out of the grid
+char tkz_grid_get(const t_grid *grid, int i, int j) {
+  if (i < 0 || i >= grid->size || j < 0 || j >= grid->size) {
+    return '\0';
+  }
+  return get_cell(i, j, grid);
+}
+
+// Skips the rest of a grid the parser gave up on: up to the next blank line,
+// '#' line or the end of the stream. `line_start` tells if the parser stopped
+// at the start of a line.
+static void skip_grid(FILE *fd, bool line_start) {
+  int read = line_start ? '\n' : fgetc(fd);
+  while (read != EOF) {
+    if (read == '\n') {
+      read = fgetc(fd);
+      if (read == '\n') {
+        return;
+      }
+      if (read == '#') {
+        ungetc(read, fd);
+        return;
+      }
+    } else {
+      read = fgetc(fd);
+    }
+  }
+}
+
+// Fails the read with `status`, then skips the rest of the grid so that the
+// next read starts with the next grid
+static tkz_status read_fail(tkz_context *ctx, FILE *fd, bool line_start,
+                            tkz_status status, const char *message) {
+  context_fail(ctx, status, "%s", message);
+  skip_grid(fd, line_start);
+  return status;
+}
+
+// Size in bytes of the binary record whose header is given, 0 if the header
+// is not valid
+size_t bin_record_size(const unsigned char *header) {
+  if (memcmp(header, BIN_MAGIC, 3) != 0 || header[3] != BIN_VERSION ||
+      !tkz_valid_size(header[4]) || header[5] != 0) {
+    return 0;
+  }
+  return BIN_HEADER_SIZE + 2 * header[4] * ((header[4] + 7) / 8);
+}
+
+// Loads a binary record of bin_record_size bytes into grid: the bit-planes
+// are the masks of the rows, only checked to be a valid grid
+tkz_status bin_decode(tkz_context *ctx, t_grid *grid,
+                      const unsigned char *record) {
+  int size = record[4];
+  int nb_bytes = (size + 7) / 8;
+  int nb_cells = record[6] | record[7] << 8;
+  grid_allocate(grid, size);
+
+  const unsigned char *plane = record + BIN_HEADER_SIZE;
+  for (int i = 0; i < size; i++) {
+    uint64_t masks[2] = {0, 0};
+    for (int v = 0; v < 2; v++) {
+      for (int b = 0; b < nb_bytes; b++) {
+        masks[v] |= (uint64_t)*plane << (8 * b);
+        plane++;
+      }
+    }
+    if ((masks[0] & masks[1]) != 0 ||
+        ((masks[0] | masks[1]) & ~line_mask(size)) != 0) {
+      context_fail(ctx, TKZ_ERROR_CHARACTER, "invalid binary row %d!", i);
+      return ctx->status;
+    }
+    for (int v = 0; v < 2; v++) {
+      for (uint64_t m = masks[v]; m != 0; m &= m - 1) {
+        set_cell(i, __builtin_ctzll(m), grid, '0' + v);
+      }
+    }
+  }
+  if (size * size - grid->empty_cells != nb_cells) {
+    context_fail(ctx, TKZ_ERROR_SHAPE, "%d cells set instead of %d!",
+                 size * size - grid->empty_cells, nb_cells);
+  }
+  return ctx->status;
+}
+
+// Reads the binary record at the current position of fd
+static tkz_status read_bin(tkz_context *ctx, t_grid *grid, FILE *fd) {
+  unsigned char record[TKZ_RECORD_SIZE];
+  if (fread(record, 1, BIN_HEADER_SIZE, fd) != BIN_HEADER_SIZE) {
+    context_fail(ctx, TKZ_ERROR_SHAPE, "truncated binary grid!");
+    return ctx->status;
+  }
+  size_t length = bin_record_size(record);
+  if (length == 0) {
+    context_fail(ctx, TKZ_ERROR_SIZE, "invalid binary grid header!");
+    return ctx->status;
+  }
+  if (fread(record + BIN_HEADER_SIZE, 1, length - BIN_HEADER_SIZE, fd) !=
+      length - BIN_HEADER_SIZE) {
+    context_fail(ctx, TKZ_ERROR_SHAPE, "truncated binary grid!");
+    return ctx->status;
+  }
+  return bin_decode(ctx, grid, record);
+}
+
+// The parser must be able to read a grid of size 4 to 64 with only one scan
+// of the stream. A stream may hold several grids, each one ending after its
+// last row, at a blank line, at a comment line ('#', skipped like the blank
+// lines before a grid) or at the end of the stream. The size of a grid is the
+// length of its first line, spaces and tabs are ignored. A grid may also be a
+// binary record (see tkz_grid_write_bin), told apart by its magic. Returns
+// TKZ_ERROR_EMPTY when there is no grid left. On another error the grid is
+// left undefined and the rest of it is skipped, the next call reads the next
+// grid.
+tkz_status tkz_grid_read(tkz_context *ctx, t_grid *grid, FILE *fd) {
+  context_reset(ctx);
+  int read;
+
+  // Blank and comment lines before the grid
+  while ((read = fgetc(fd)) == '\n' || read == ' ' || read == '\t' ||
+         read == '#') {
+    if (read == '#') {
+      while ((read = fgetc(fd)) != '\n' && read != EOF) {
+      }
+      if (read == EOF) {
+        break;
+      }
+    }
+  }
+  if (read == EOF) {
+    context_fail(ctx, TKZ_ERROR_EMPTY, "empty file!");
+    return ctx->status;
+  }
+  if (read == BIN_MAGIC[0]) {
+    ungetc(read, fd);
+    return read_bin(ctx, grid, fd);
+  }
+
+  // Read the first line to get the grid size
+  char line[MAX_GRID_SIZE];
+  int lineSize = 0;
+  for (; read != '\n' && read != EOF; read = fgetc(fd)) {
+    if (read == ' ' || read == '\t') {
+      // ignore and skip
+    } else if (!check_char(read)) {
+      return read_fail(ctx, fd, false, TKZ_ERROR_CHARACTER,
+                       "invalid character!");
+    } else if (lineSize == MAX_GRID_SIZE) {
+      return read_fail(ctx, fd, false, TKZ_ERROR_SIZE,
+                       "Invalid size, the first line has more than 64 cells!");
+    } else {
+      line[lineSize] = read;
+      lineSize++;
+    }
+  }
+
+  if (tkz_grid_init(ctx, grid, lineSize) != TKZ_OK) {
+    skip_grid(fd, read == '\n');
+    return ctx->status;
+  }
+  for (int i = 0; i < lineSize; i++) {
+    set_cell(0, i, grid, line[i]);
+  }
+
+  int currentRow = 1;  // 1 because we already read the first line
+  int currentColumn = 0;
+
+  while (read != EOF && (read = fgetc(fd)) != EOF) {
+    if (read == '\n') {
+      // a blank line ends the grid
+      if (currentColumn == 0) {
+        break;
+      }
+      // not enough chars
+      if (currentColumn != lineSize) {
+        return read_fail(ctx, fd, true, TKZ_ERROR_SHAPE,
+                         "inconsistent number of char by row!");
+      }
+      currentRow++;
+      currentColumn = 0;
+      // as does its last row
+      if (currentRow == lineSize) {
+        break;
+      }
+    } else if (read == '#' && currentColumn == 0) {
+      // as does the comment line of the next grid
+      ungetc(read, fd);
+      break;
+    } else if (read == ' ' || read == '\t') {
+      // ignore and skip
+    } else if (!check_char(read)) {
+      return read_fail(ctx, fd, false, TKZ_ERROR_CHARACTER,
+                       "invalid character!");
+    } else if (currentColumn == lineSize) {
+      // too much chars
+      return read_fail(ctx, fd, false, TKZ_ERROR_SHAPE,
+                       "inconsistent number of char by row!");
+    } else {
+      set_cell(currentRow, currentColumn, grid, read);
+      currentColumn++;
+    }
+  }
+  if (ferror(fd)) {
+    context_fail(ctx, TKZ_ERROR_IO, "could not read the grid");
+    return ctx->status;
+  }
+
+  // the last row may not end with a newline
+  if (currentColumn == lineSize) {
+    currentRow++;
+  } else if (currentColumn != 0) {
+    context_fail(ctx, TKZ_ERROR_SHAPE, "inconsistent number of char by row!");
+    return ctx->status;
+  }
+  if (currentRow != lineSize) {
+    context_fail(ctx, TKZ_ERROR_SHAPE, "%d rows for %d columns!", currentRow,
+                 lineSize);
+  }
+  return ctx->status;
+}
+
+void tkz_grid_write(const t_grid *grid, FILE *fd) { grid_print(grid, fd); }
+
+// Renders grid as text to text (TKZ_TEXT_SIZE bytes), see grid_render
+size_t tkz_grid_format(const t_grid *grid, char *text, bool one_line) {
+  return grid_render(grid, text, one_line);
+}
+
+// Writes grid as a binary record: the header BIN_MAGIC, BIN_VERSION, the size,
+// a zero byte and the number of cells set (16 bits, little endian), then for
+// every row the mask of its zeros and the mask of its ones (as in t_grid.rows)
+// on (size + 7) / 8 bytes each, little endian. A 64x64 grid takes 1032 bytes
+// instead of 4160 as text. tkz_grid_encode_bin leaves the record in record
+// (TKZ_RECORD_SIZE bytes) and returns its size.
+size_t tkz_grid_encode_bin(const t_grid *grid, unsigned char *record) {
+  int size = grid->size;
+  int nb_bytes = (size + 7) / 8;
+  int nb_cells = size * size - grid->empty_cells;
+  memcpy(record, BIN_MAGIC, 3);
+  record[3] = BIN_VERSION;
+  record[4] = size;
+  record[5] = 0;
+  record[6] = nb_cells & 0xff;
+  record[7] = nb_cells >> 8;
+
+  unsigned char *plane = record + BIN_HEADER_SIZE;
+  for (int i = 0; i < size; i++) {
+    for (int v = 0; v < 2; v++) {
+      for (int b = 0; b < nb_bytes; b++) {
+        *plane = grid->rows[v][i] >> (8 * b);
+        plane++;
+      }
+    }
+  }
+  return plane - record;
+}
+
+void tkz_grid_write_bin(const t_grid *grid, FILE *fd) {
+  unsigned char record[TKZ_RECORD_SIZE];
+  fwrite(record, 1, tkz_grid_encode_bin(grid, record), fd);
+}
+
+// Hands every solution of grid (up to the limit of the options, only the
+// first one in MODE_FIRST) to callback, or only counts them if callback is
+// NULL. The number of solutions found is left in ctx->nb_solutions, grid is
+// not modified.
+tkz_status tkz_solve(tkz_context *ctx, const t_grid *grid,
+                     const tkz_options *opts, t_solution_callback callback,
+                     void *data) {
+  context_reset(ctx);
+  ctx->nb_solutions = 0;
+  ctx->nb_nodes = 0;
+  ctx->options = *opts;
+  if (!check_options(ctx, opts)) {
+    return ctx->status;
+  }
+  if (ctx->log != NULL) {
+    fprintf(ctx->log, "Solving grid...\n");
+  }
+
+  t_grid work;
+  grid_copy(grid, &work);
+  if (!is_consistent(&work)) {
+    if (ctx->log != NULL) {
+      fprintf(ctx->log, "Impossible to solve starting grid is inconsistent\n");
+    }
+    context_fail(ctx, TKZ_ERROR_INCONSISTENT, "%s",
+                 tkz_strerror(TKZ_ERROR_INCONSISTENT));
+    return ctx->status;
+  }
+
+  t_sink sink = {callback, data, 0, opts->limit};
+  ctx->nb_solutions = grid_solver(ctx, &work, &sink, opts->mode);
+  ctx->nb_nodes = sink.nodes;
+  return ctx->status;
+}
+
+// Initializes grid to a random grid of the given size with percentage_fill
+// percent of its cells set, with exactly one solution if unique
+tkz_status tkz_generate(tkz_context *ctx, t_grid *grid, int size,
+                        int percentage_fill, bool unique,
+                        const tkz_options *opts) {
+  context_reset(ctx);
+  ctx->options = *opts;
+  if (!check_options(ctx, opts) ||
+      tkz_grid_init(ctx, grid, size) != TKZ_OK) {
+    return ctx->status;
+  }
+  if (percentage_fill < 0 || percentage_fill > 100) {
+    context_fail(ctx, TKZ_ERROR_ARGUMENT, "invalid fill percentage %d",
+                 percentage_fill);
+    return ctx->status;
+  }
+
+  if (unique) {
+    generate_unique_grid(ctx, grid, percentage_fill);
+  } else {
+    generate_grid(ctx, grid, percentage_fill);
+  }
+  return ctx->status;
+}
+
+// Writes grid as a DIMACS CNF formula, see cnf_write
+tkz_status tkz_export_cnf(tkz_context *ctx, const t_grid *grid, FILE *fd) {
+  context_reset(ctx);
+  cnf_write(grid, fd);
+  if (fflush(fd) != 0 || ferror(fd)) {
+    context_fail(ctx, TKZ_ERROR_IO, "could not write the CNF formula");
+  }
+  return ctx->status;
+}
@@ -0,0 +1,140 @@
+#include "output.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libtakuzu.h"
+#include "takuzu.h"
+
+// Longest text print_solution adds for a solution: its two header lines and
+// the grid
+#define SOLUTION_SIZE (64 + TKZ_TEXT_SIZE)
+
+// A printer without buffer (or whose buffer can't be allocated) writes every
+// solution with its own fwrite
+void printer_init(t_printer *printer, FILE *fd, bool buffered) {
+  printer->fd = fd;
+  printer->printed = 0;
+  printer->buffer = buffered ? malloc(PRINT_BUFFER_SIZE) : NULL;
+  printer->length = 0;
+  printer->error = 0;
+}
+
+// Writes the pending solutions. What was printed to fd before comes first, then
+// the buffer goes to the file descriptor in as few write calls as the kernel
+// accepts, with no copy through the stdio buffer. A write that fails is
+// recorded in printer->error, the solutions after it are dropped.
+void printer_flush(t_printer *printer) {
+  if (printer->length == 0) {
+    return;
+  }
+  fflush(printer->fd);
+  int fd = fileno(printer->fd);
+  if (fd < 0) {
+    // not backed by a file descriptor (an in-memory stream)
+    if (fwrite(printer->buffer, 1, printer->length, printer->fd) <
+            printer->length &&
+        printer->error == 0) {
+      printer->error = errno != 0 ? errno : EIO;
+    }
+    printer->length = 0;
+    return;
+  }
+
+  const char *pending = printer->buffer;
+  size_t left = printer->length;
+  while (left > 0 && printer->error == 0) {
+    ssize_t written = write(fd, pending, left);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      // the output is gone (closed pipe, full disk)
+      printer->error = written < 0 ? errno : EIO;
+      break;
+    }
+    pending += written;
+    left -= written;
+  }
+  printer->length = 0;
+}
+
+void printer_free(t_printer *printer) {
+  printer_flush(printer);
+  free(printer->buffer);
+  printer->buffer = NULL;
+}
+
+// Appends the decimal digits of n (positive) to out, returns the end of them
+static char *append_long(char *out, long n) {
+  char digits[24];
+  int nb_digits = 0;
+  do {
+    digits[nb_digits++] = '0' + n % 10;
+    n /= 10;
+  } while (n > 0);
+  while (nb_digits > 0) {
+    *out++ = digits[--nb_digits];
+  }
+  return out;
+}
+
+static char *append_string(char *out, const char *s) {
+  size_t length = strlen(s);
+  memcpy(out, s, length);
+  return out + length;
+}
+
+// Writes grid in the format of the command line
+void write_grid(const t_grid *grid, FILE *fd) {
+  if (sw.format == FORMAT_BIN) {
+    tkz_grid_write_bin(grid, fd);
+  } else {
+    char text[TKZ_TEXT_SIZE];
+    fwrite(text, 1, tkz_grid_format(grid, text, sw.format == FORMAT_LINE),
+           fd);
+  }
+}
+
+// Solution callback of the solver: solutions are rendered as soon as they are
+// found, `data` is a t_printer. Text solutions get a header, line and binary
+// ones are written alone, one after the other.
+void print_solution(const t_grid *solution, void *data) {
+  t_printer *printer = data;
+  printer->printed += 1;
+
+  char scratch[SOLUTION_SIZE];
+  char *start = scratch;
+  if (printer->buffer != NULL) {
+    if (printer->length + SOLUTION_SIZE > PRINT_BUFFER_SIZE) {
+      printer_flush(printer);
+    }
+    start = printer->buffer + printer->length;
+  }
+
+  char *end = start;
+  if (sw.format == FORMAT_BIN) {
+    end += tkz_grid_encode_bin(solution, (unsigned char *)start);
+  } else if (sw.format == FORMAT_LINE) {
+    end += tkz_grid_format(solution, start, true);
+  } else {
+    end = append_string(end, "Solution ");
+    end = append_long(end, printer->printed);
+    end = append_string(end, "\nGrid for solution ");
+    end = append_long(end, printer->printed);
+    end = append_string(end, ":\n");
+    end += tkz_grid_format(solution, end, false);
+  }
+
+  if (printer->buffer != NULL) {
+    printer->length += end - start;
+  } else if (fwrite(start, 1, end - start, printer->fd) <
+                 (size_t)(end - start) &&
+             printer->error == 0) {
+    printer->error = errno != 0 ? errno : EIO;
+  }
+}
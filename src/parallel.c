@@ -0,0 +1,353 @@
+#include "parallel.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "grid.h"
+#include "libtakuzu.h"
+#include "rng.h"
+
+// A worker hands the other branch of a choice to the pool as long as its own
+// deque holds fewer tasks than this, otherwise it explores both branches
+// itself like grid_solver_recursive
+#define SPLIT_THRESHOLD 4
+
+// Double ended queue of tasks (grids to solve). The owner pushes and pops at
+// the bottom (tail), the other workers steal from the top (head), so that
+// thieves take the oldest tasks, which are the closest to the root.
+typedef struct {
+  t_grid *tasks;  // Ring buffer of tasks
+  int head;       // Index of the top task
+  int size;       // Number of tasks
+  int capacity;   // Number of tasks allocated
+  pthread_mutex_t lock;
+} t_deque;
+
+struct s_pool;
+
+typedef struct {
+  struct s_pool *pool;
+  int id;
+  t_deque deque;
+  t_grid grid;             // Grid of the task being solved
+  t_trail trail;           // Undo trail of grid
+  uint64_t rng[4];         // Random choices, the context's one is shared
+  long nodes;              // Nodes visited, added to the sink at the end
+  long count;              // Solutions counted without limit, same as above
+  pthread_t thread;
+} t_worker;
+
+typedef struct s_pool {
+  t_worker *workers;
+  int nb_workers;
+  t_mode mode;
+  tkz_context *ctx;          // Errors are reported under sink_lock
+  t_sink *sink;              // Shared by the workers, guarded by sink_lock
+  pthread_mutex_t sink_lock;
+  // Without callback nothing needs the lock: the solutions are counted by
+  // each worker, or in found when there is a count to stop at
+  long cap;            // Solutions to stop at when counting, 0: no limit
+  atomic_long found;   // Solutions counted when cap > 0
+  atomic_int pending;  // Tasks pushed and not finished yet
+  atomic_bool stop;    // Set when the sink does not need more solutions
+  // Idle workers wait on work_ready, signaled when a task is pushed and
+  // broadcast when pending drops to 0 or stop is set
+  pthread_mutex_t idle_lock;
+  pthread_cond_t work_ready;
+} t_pool;
+
+static bool deque_init(t_deque *d) {
+  d->head = 0;
+  d->size = 0;
+  d->capacity = 16;
+  d->tasks = malloc(d->capacity * sizeof(t_grid));
+  pthread_mutex_init(&d->lock, NULL);
+  return d->tasks != NULL;
+}
+
+static void deque_free(t_deque *d) {
+  free(d->tasks);
+  pthread_mutex_destroy(&d->lock);
+}
+
+static int deque_size(t_deque *d) {
+  pthread_mutex_lock(&d->lock);
+  int size = d->size;
+  pthread_mutex_unlock(&d->lock);
+  return size;
+}
+
+// Returns false if the deque is full and can't grow
+static bool deque_push(t_deque *d, const t_grid *task) {
+  pthread_mutex_lock(&d->lock);
+  if (d->size == d->capacity) {
+    t_grid *tasks = malloc(2 * d->capacity * sizeof(t_grid));
+    if (tasks == NULL) {
+      pthread_mutex_unlock(&d->lock);
+      return false;
+    }
+    for (int k = 0; k < d->size; k++) {
+      tasks[k] = d->tasks[(d->head + k) % d->capacity];
+    }
+    free(d->tasks);
+    d->tasks = tasks;
+    d->head = 0;
+    d->capacity *= 2;
+  }
+  d->tasks[(d->head + d->size) % d->capacity] = *task;
+  d->size++;
+  pthread_mutex_unlock(&d->lock);
+  return true;
+}
+
+// Owner side: takes the most recent task
+static bool deque_pop(t_deque *d, t_grid *task) {
+  pthread_mutex_lock(&d->lock);
+  bool found = d->size > 0;
+  if (found) {
+    d->size--;
+    *task = d->tasks[(d->head + d->size) % d->capacity];
+  }
+  pthread_mutex_unlock(&d->lock);
+  return found;
+}
+
+// Thief side: takes the oldest task
+static bool deque_steal(t_deque *d, t_grid *task) {
+  pthread_mutex_lock(&d->lock);
+  bool found = d->size > 0;
+  if (found) {
+    *task = d->tasks[d->head];
+    d->head = (d->head + 1) % d->capacity;
+    d->size--;
+  }
+  pthread_mutex_unlock(&d->lock);
+  return found;
+}
+
+// Stops the workers, including the idle ones
+static void pool_stop(t_pool *pool) {
+  atomic_store(&pool->stop, true);
+  pthread_mutex_lock(&pool->idle_lock);
+  pthread_cond_broadcast(&pool->work_ready);
+  pthread_mutex_unlock(&pool->idle_lock);
+}
+
+// Records an error of a worker and stops the others
+static void pool_fail(t_pool *pool, tkz_status status, const char *message) {
+  pthread_mutex_lock(&pool->sink_lock);
+  context_fail(pool->ctx, status, "%s", message);
+  pthread_mutex_unlock(&pool->sink_lock);
+  pool_stop(pool);
+}
+
+// Hands grid with `choice` applied to the pool
+static void push_branch(t_worker *w, t_grid *grid, choice_t choice) {
+  t_grid task;
+  grid_copy(grid, &task);
+  set_cell(choice.row, choice.column, &task, choice.choice);
+  atomic_fetch_add(&w->pool->pending, 1);
+  if (!deque_push(&w->deque, &task)) {
+    atomic_fetch_sub(&w->pool->pending, 1);
+    pool_fail(w->pool, TKZ_ERROR_MEMORY, "could not grow a task queue");
+    return;
+  }
+  pthread_mutex_lock(&w->pool->idle_lock);
+  pthread_cond_signal(&w->pool->work_ready);
+  pthread_mutex_unlock(&w->pool->idle_lock);
+}
+
+// Same search as grid_solver_recursive, except that the second branch of a
+// choice is pushed on the worker's deque (where idle workers can steal it)
+// while the deque runs low
+static void parallel_recursive(t_worker *w) {
+  t_grid *grid = &w->grid;
+  tkz_context *ctx = w->pool->ctx;
+  if (atomic_load_explicit(&w->pool->stop, memory_order_relaxed)) {
+    return;
+  }
+  w->nodes++;
+
+  if (!grid_propagate(ctx, grid)) {
+    return;
+  }
+
+  if (is_grid_full(grid)) {
+    t_pool *pool = w->pool;
+    if (pool->sink->callback == NULL) {
+      if (pool->cap == 0) {
+        w->count++;
+      } else if (atomic_fetch_add(&pool->found, 1) + 1 >= pool->cap) {
+        // the workers that get past the cap too are not counted at the end
+        pool_stop(pool);
+      }
+      return;
+    }
+    pthread_mutex_lock(&pool->sink_lock);
+    // other workers may have reached the limit in the meantime
+    if (!sink_done(pool->sink, pool->mode)) {
+      sink_emit(pool->sink, grid);
+    }
+    if (sink_done(pool->sink, pool->mode)) {
+      pool_stop(pool);
+    }
+    pthread_mutex_unlock(&pool->sink_lock);
+    return;
+  }
+
+  choice_t choice = grid_choice(ctx, grid, ctx->options.branching, w->rng);
+  choice_t other = choice;
+  other.choice = choice.choice == '0' ? '1' : '0';  // invert choice
+  int mark = trail_mark(grid);
+
+  if (deque_size(&w->deque) < SPLIT_THRESHOLD) {
+    push_branch(w, grid, other);
+    grid_choice_apply(ctx, grid, choice);
+    parallel_recursive(w);
+    trail_undo(grid, mark);
+    return;
+  }
+
+  grid_choice_apply(ctx, grid, choice);
+  parallel_recursive(w);
+  trail_undo(grid, mark);
+
+  grid_choice_apply(ctx, grid, other);
+  parallel_recursive(w);
+  trail_undo(grid, mark);
+}
+
+// Looks for a task in the deque of the other workers, starting with the next
+// one so that thieves spread over the pool
+static bool steal_task(t_worker *w) {
+  t_pool *pool = w->pool;
+  for (int k = 1; k < pool->nb_workers; k++) {
+    t_worker *victim = &pool->workers[(w->id + k) % pool->nb_workers];
+    if (deque_steal(&victim->deque, &w->grid)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void *worker_run(void *arg) {
+  t_worker *w = arg;
+  t_pool *pool = w->pool;
+
+  while (true) {
+    if (!deque_pop(&w->deque, &w->grid) && !steal_task(w)) {
+      // No task anywhere, but the running ones may still push some. The
+      // conditions are checked again under idle_lock, which the workers
+      // changing them take before waking this one up.
+      bool found = false;
+      pthread_mutex_lock(&pool->idle_lock);
+      while (!(found = steal_task(w)) && atomic_load(&pool->pending) > 0 &&
+             !atomic_load(&pool->stop)) {
+        pthread_cond_wait(&pool->work_ready, &pool->idle_lock);
+      }
+      pthread_mutex_unlock(&pool->idle_lock);
+      if (!found) {
+        break;
+      }
+    }
+
+    w->trail.length = 0;
+    w->grid.trail = &w->trail;
+    parallel_recursive(w);
+    if (atomic_fetch_sub(&pool->pending, 1) == 1) {
+      // the last task is done, the idle workers can leave
+      pthread_mutex_lock(&pool->idle_lock);
+      pthread_cond_broadcast(&pool->work_ready);
+      pthread_mutex_unlock(&pool->idle_lock);
+    }
+  }
+  return NULL;
+}
+
+// Solves grid with nb_threads workers, each one with its own grid and trail.
+// Solutions are handed to the sink as they are found, one worker at a time
+// and in no particular order, or only counted (without taking any lock) if
+// the sink has no callback. Returns the number of solutions found (at most
+// one in MODE_FIRST, at most the limit of the sink if it has one), errors
+// are left in the context.
+long grid_solver_parallel(tkz_context *ctx, t_grid *grid, t_sink *sink,
+                          const t_mode mode, int nb_threads) {
+  t_pool pool;
+  pool.nb_workers = nb_threads;
+  pool.mode = mode;
+  pool.ctx = ctx;
+  pool.sink = sink;
+  pthread_mutex_init(&pool.sink_lock, NULL);
+  pthread_mutex_init(&pool.idle_lock, NULL);
+  pthread_cond_init(&pool.work_ready, NULL);
+  atomic_init(&pool.pending, 1);
+  atomic_init(&pool.stop, false);
+  pool.cap = mode == MODE_FIRST ? 1 : sink->limit;
+  atomic_init(&pool.found, 0);
+  pool.workers = calloc(nb_threads, sizeof(t_worker));
+  if (pool.workers == NULL) {
+    context_fail(ctx, TKZ_ERROR_MEMORY, "could not allocate the workers");
+    pthread_mutex_destroy(&pool.sink_lock);
+    pthread_mutex_destroy(&pool.idle_lock);
+    pthread_cond_destroy(&pool.work_ready);
+    return 0;
+  }
+
+  bool allocated = true;
+  uint64_t seed = rng_next(ctx->rng);
+  for (int k = 0; k < nb_threads; k++) {
+    t_worker *w = &pool.workers[k];
+    w->pool = &pool;
+    w->id = k;
+    // a stream per worker, all of them following from the context's seed
+    rng_seed(w->rng, seed, k);
+    allocated &= deque_init(&w->deque);
+    allocated &= trail_init(&w->trail, grid->size);
+  }
+
+  // The root task examines every line once before the first choice
+  t_grid root;
+  grid_copy(grid, &root);
+  root.queue_rows = line_mask(grid->size);
+  root.queue_cols = line_mask(grid->size);
+  if (!allocated || !deque_push(&pool.workers[0].deque, &root)) {
+    context_fail(ctx, TKZ_ERROR_MEMORY, "could not allocate the workers");
+    nb_threads = 0;
+  }
+
+  int started = 0;
+  while (started < nb_threads &&
+         pthread_create(&pool.workers[started].thread, NULL, worker_run,
+                        &pool.workers[started]) == 0) {
+    started++;
+  }
+  if (started < nb_threads) {
+    // The workers started drop their tasks and leave
+    pool_fail(&pool, TKZ_ERROR_THREAD, "could not start a solver thread");
+  }
+
+  // Idle workers wait for tasks until every one is done, so nothing is
+  // released before they have all stopped
+  for (int k = 0; k < started; k++) {
+    pthread_join(pool.workers[k].thread, NULL);
+  }
+
+  if (sink->callback == NULL && pool.cap > 0) {
+    long found = atomic_load(&pool.found);
+    sink->count += found < pool.cap ? found : pool.cap;
+  }
+  for (int k = 0; k < pool.nb_workers; k++) {
+    sink->nodes += pool.workers[k].nodes;
+    sink->count += pool.workers[k].count;
+    trail_free(&pool.workers[k].trail);
+    deque_free(&pool.workers[k].deque);
+  }
+  free(pool.workers);
+  pthread_mutex_destroy(&pool.sink_lock);
+  pthread_mutex_destroy(&pool.idle_lock);
+  pthread_cond_destroy(&pool.work_ready);
+
+  return sink->count;
+}
@@ -0,0 +1,142 @@
+#include "patterns.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// One table per size up to PATTERNS_MAX_SIZE (4, 8 and 16 in practice), all
+// built once before the first use. They are only read afterwards, every
+// solver thread and every context shares them.
+static t_patterns tables[PATTERNS_MAX_SIZE + 1];
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static bool is_valid_line(uint64_t ones, int size) {
+  uint64_t mask = (UINT64_C(1) << size) - 1;
+  uint64_t zeros = ~ones & mask;
+  return __builtin_popcountll(ones) == size / 2 &&
+         (ones & (ones >> 1) & (ones >> 2)) == 0 &&
+         (zeros & (zeros >> 1) & (zeros >> 2)) == 0;
+}
+
+static void free_table(t_patterns *p) {
+  free(p->index);
+  free(p->lines);
+  free(p->has[0]);
+  free(p->has[1]);
+  p->index = NULL;
+  p->lines = NULL;
+  p->has[0] = NULL;
+  p->has[1] = NULL;
+}
+
+// Returns false if the table could not be allocated, it is then left empty
+static bool build_table(t_patterns *p, int size) {
+  uint64_t nb_lines = UINT64_C(1) << size;
+  p->size = size;
+  p->count = 0;
+  p->index = calloc(nb_lines, sizeof(int));
+  if (p->index == NULL) {
+    return false;
+  }
+  for (uint64_t ones = 0; ones < nb_lines; ones++) {
+    p->index[ones] = is_valid_line(ones, size) ? p->count++ : -1;
+  }
+
+  p->words = (p->count + 63) / 64;
+  p->lines = calloc(p->count, sizeof(uint64_t));
+  p->has[0] = calloc(size * p->words, sizeof(uint64_t));
+  p->has[1] = calloc(size * p->words, sizeof(uint64_t));
+  if (p->lines == NULL || p->has[0] == NULL || p->has[1] == NULL) {
+    free_table(p);
+    return false;
+  }
+  for (uint64_t ones = 0; ones < nb_lines; ones++) {
+    int index = p->index[ones];
+    if (index < 0) {
+      continue;
+    }
+    p->lines[index] = ones;
+    for (int k = 0; k < size; k++) {
+      int v = (ones >> k) & 1;
+      p->has[v][k * p->words + index / 64] |= UINT64_C(1) << (index % 64);
+    }
+  }
+  return true;
+}
+
+static void build_tables(void) {
+  for (int size = 4; size <= PATTERNS_MAX_SIZE; size *= 2) {
+    build_table(&tables[size], size);
+  }
+}
+
+// Table of the valid lines of the given size, NULL if the size is too big
+// for the lines to be enumerated (or if their table could not be allocated,
+// the solver then does without)
+const t_patterns *patterns_get(int size) {
+  if (size > PATTERNS_MAX_SIZE) {
+    return NULL;
+  }
+  pthread_once(&tables_once, build_tables);
+  return tables[size].lines != NULL ? &tables[size] : NULL;
+}
+
+// Domain of a line: the valid lines that agree with every cell already set
+void patterns_domain(const t_patterns *p, uint64_t zeros, uint64_t ones,
+                     uint64_t *domain) {
+  for (int w = 0; w < p->words; w++) {
+    domain[w] = UINT64_MAX;
+  }
+  if (p->count % 64) {
+    domain[p->words - 1] = (UINT64_C(1) << (p->count % 64)) - 1;
+  }
+
+  for (int v = 0; v < 2; v++) {
+    for (uint64_t cells = v ? ones : zeros; cells; cells &= cells - 1) {
+      const uint64_t *has = &p->has[v][__builtin_ctzll(cells) * p->words];
+      for (int w = 0; w < p->words; w++) {
+        domain[w] &= has[w];
+      }
+    }
+  }
+}
+
+// Removes a full line (given by its ones) from a domain, two lines of the
+// same direction can't be identical
+void patterns_exclude(const t_patterns *p, uint64_t line, uint64_t *domain) {
+  int index = p->index[line];
+  if (index >= 0) {
+    domain[index / 64] &= ~(UINT64_C(1) << (index % 64));
+  }
+}
+
+// Cells on which every line of the domain agree, a domain with a single line
+// left forces the whole line: a cell is forced to v when the domain has no
+// line in common with has[!v] at its position. Only the words where the
+// domain has lines are looked at, and the scan stops as soon as every cell
+// has been seen with both values. Returns false if the domain is empty.
+bool patterns_forced(const t_patterns *p, const uint64_t *domain,
+                     uint64_t *to_zero, uint64_t *to_one) {
+  uint64_t all_cells = (UINT64_C(1) << p->size) - 1;
+  uint64_t seen[2] = {0, 0};  // cells where some line of the domain has v
+  bool empty = true;
+  for (int w = 0; w < p->words && (seen[0] & seen[1]) != all_cells; w++) {
+    uint64_t lines = domain[w];
+    if (lines == 0) {
+      continue;
+    }
+    empty = false;
+    for (int k = 0; k < p->size; k++) {
+      uint64_t bit = UINT64_C(1) << k;
+      for (int v = 0; v < 2; v++) {
+        if ((lines & p->has[v][k * p->words + w]) != 0) {
+          seen[v] |= bit;
+        }
+      }
+    }
+  }
+  *to_zero = ~seen[1] & all_cells;
+  *to_one = ~seen[0] & all_cells;
+  return !empty;
+}
@@ -0,0 +1,58 @@
+#include "rng.h"
+
+#include <stdint.h>
+
+// Pseudo-random numbers of the library: xoshiro256** (Blackman and Vigna),
+// a few cycles per number, with its state in the context so that every
+// context (and therefore every thread) has its own sequence.
+
+// Next output of splitmix64, only used to expand a seed into a state
+static uint64_t splitmix64(uint64_t *x) {
+  uint64_t z = (*x += UINT64_C(0x9E3779B97F4A7C15));
+  z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+  z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+  return z ^ (z >> 31);
+}
+
+// Initializes the state from a seed and a stream number: the same seed and
+// stream always give the same sequence, different streams of a seed give
+// sequences as unrelated as different seeds
+void rng_seed(uint64_t state[4], uint64_t seed, uint64_t stream) {
+  uint64_t x = seed;
+  uint64_t mix = splitmix64(&x) ^ stream;
+  x = mix * UINT64_C(0xD1B54A32D192ED03);
+  for (int k = 0; k < 4; k++) {
+    state[k] = splitmix64(&x);
+  }
+}
+
+static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+uint64_t rng_next(uint64_t state[4]) {
+  uint64_t result = rotl(state[1] * 5, 7) * 9;
+  uint64_t t = state[1] << 17;
+  state[2] ^= state[0];
+  state[3] ^= state[1];
+  state[1] ^= state[2];
+  state[0] ^= state[3];
+  state[2] ^= t;
+  state[3] = rotl(state[3], 45);
+  return result;
+}
+
+// Uniform number in [0, bound), bound > 0. rng_next() % bound would favour
+// the small numbers, the multiply-shift of Lemire only rejects the few
+// products that would (less than bound out of 2^32, usually none) and needs
+// no division on the common path.
+uint32_t rng_below(uint64_t state[4], uint32_t bound) {
+  uint64_t product = (rng_next(state) >> 32) * bound;
+  uint32_t low = (uint32_t)product;
+  if (low < bound) {
+    uint32_t threshold = -bound % bound;
+    while (low < threshold) {
+      product = (rng_next(state) >> 32) * bound;
+      low = (uint32_t)product;
+    }
+  }
+  return product >> 32;
+}
@@ -0,0 +1,100 @@
+#include "symmetry.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "grid.h"
+#include "libtakuzu.h"
+
+// Mirrors the `size` low bits of m
+static uint64_t reverse_line(uint64_t m, int size) {
+  m = ((m >> 1) & UINT64_C(0x5555555555555555)) |
+      ((m & UINT64_C(0x5555555555555555)) << 1);
+  m = ((m >> 2) & UINT64_C(0x3333333333333333)) |
+      ((m & UINT64_C(0x3333333333333333)) << 2);
+  m = ((m >> 4) & UINT64_C(0x0F0F0F0F0F0F0F0F)) |
+      ((m & UINT64_C(0x0F0F0F0F0F0F0F0F)) << 4);
+  m = __builtin_bswap64(m);
+  return m >> (64 - size);
+}
+
+// Row i of the image of g by the symmetry e
+static void image_row(const t_grid *g, int e, int i, uint64_t *zeros,
+                      uint64_t *ones) {
+  int k = (e & SYM_FLIP) ? g->size - 1 - i : i;
+  uint64_t z = (e & SYM_USE_COLS) ? g->cols[0][k] : g->rows[0][k];
+  uint64_t o = (e & SYM_USE_COLS) ? g->cols[1][k] : g->rows[1][k];
+  if (e & SYM_REVERSE) {
+    z = reverse_line(z, g->size);
+    o = reverse_line(o, g->size);
+  }
+  *zeros = (e & SYM_SWAP) ? o : z;
+  *ones = (e & SYM_SWAP) ? z : o;
+}
+
+// Compares g with its image by e in row-major order, '0' before '1'.
+// Returns -1 or 1 once decided, 0 if they are equal or if an empty cell
+// comes before their first difference.
+static int compare_image(const t_grid *g, int e) {
+  uint64_t mask = line_mask(g->size);
+  for (int i = 0; i < g->size; i++) {
+    uint64_t zeros;
+    uint64_t ones;
+    image_row(g, e, i, &zeros, &ones);
+    uint64_t both = (g->rows[0][i] | g->rows[1][i]) & (zeros | ones);
+    uint64_t undefined = mask & ~both;
+    uint64_t diff = (g->rows[1][i] ^ ones) & both;
+    if (diff == 0 && undefined == 0) {
+      continue;
+    }
+    if (diff != 0 &&
+        (undefined == 0 || __builtin_ctzll(diff) < __builtin_ctzll(undefined))) {
+      return (g->rows[1][i] >> __builtin_ctzll(diff)) & 1 ? 1 : -1;
+    }
+    return 0;
+  }
+  return 0;
+}
+
+// Symmetries that map g (given cells and empty ones) onto itself, the
+// solutions of g are then mapped onto solutions of g
+void symmetries_detect(const t_grid *g, t_symmetries *h) {
+  h->count = 0;
+  for (int e = 0; e < SYM_GROUP_SIZE; e++) {
+    bool fixed = true;
+    for (int i = 0; i < g->size && fixed; i++) {
+      uint64_t zeros;
+      uint64_t ones;
+      image_row(g, e, i, &zeros, &ones);
+      fixed = zeros == g->rows[0][i] && ones == g->rows[1][i];
+    }
+    if (fixed) {
+      h->elements[h->count++] = e;
+    }
+  }
+}
+
+// Lex-leader pruning: false if no completion of g can be the smallest grid
+// of its orbit, some symmetry already maps it onto a smaller grid
+bool symmetries_may_lead(const t_grid *g, const t_symmetries *h) {
+  for (int k = 1; k < h->count; k++) {
+    if (compare_image(g, h->elements[k]) > 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Number of solutions a full grid stands for: the size of its orbit
+// |H| / |stabilizer| if it is the smallest grid of its orbit, 0 otherwise
+long symmetries_weight(const t_grid *g, const t_symmetries *h) {
+  int stabilizer = 1;  // the identity
+  for (int k = 1; k < h->count; k++) {
+    int cmp = compare_image(g, h->elements[k]);
+    if (cmp > 0) {
+      return 0;
+    }
+    stabilizer += cmp == 0;
+  }
+  return h->count / stabilizer;
+}
@@ -9,144 +9,274 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 
-#include "grid.h"
+#include "batch.h"
+#include "bulk.h"
+#include "libtakuzu.h"
+#include "output.h"
 
 software_info sw = {
     .mode = NONE,
     .output_file = NULL,  // Can't be initialized to stdout because it is not a
                           // constant, but it is initialized in main
                           // (which is called before any use)
+    .info_file = NULL,
+    .format = FORMAT_TEXT,
 
     .grid = NULL,
     .grid_size = 0,
     .percentage_fill = 20,
-
+    .nb_puzzles = 0,
+    .seed = 0,
+    .seeded = false,
+    .engine = ENGINE_BACKTRACK,
+    .sat_solver = NULL,
+    .cnf_file = NULL,
+    .index_file = NULL,
+    .grid_number = 0,
+    .branching = BRANCH_LINE,
+    .threads = 1,
+    .lookahead = 0,
+
+    .batch = false,
     .all = false,
+    .count = false,
+    .symmetry = true,
+    .limit = 0,
     .unique = false,
     .verbose = false,
+    .stats = false,
 };
 
 t_mode mode = MODE_FIRST;
 
+// Options of the library calls, from the command line
+static void cli_options(tkz_options *opts) {
+  tkz_options_init(opts);
+  opts->engine = sw.engine;
+  opts->branching = sw.branching;
+  opts->mode = mode;
+  opts->limit = sw.limit;
+  // in batch and bulk modes the threads work on different grids
+  opts->threads = sw.batch || sw.nb_puzzles > 0 ? 1 : sw.threads;
+  opts->lookahead = sw.lookahead;
+  opts->symmetry = sw.symmetry;
+  opts->sat_solver = sw.sat_solver;
+}
+
+// Stops the program if the last library call failed
+void exit_on_error(const tkz_context *ctx) {
+  if (ctx->status != TKZ_OK) {
+    fprintf(stderr, "ERROR -> %s\n",
+            ctx->message[0] != '\0' ? ctx->message
+                                    : tkz_strerror(ctx->status));
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Last lines printed about a grid once solved
+void print_count(FILE *fd, long nb_solutions) {
+  fprintf(fd, "Number of solutions: %ld\n", nb_solutions);
+  if (sw.limit > 0 && nb_solutions >= sw.limit) {
+    fprintf(fd, "Limit of %ld solutions reached\n", sw.limit);
+  }
+}
+
+// Solutions are streamed to the output through the buffer of a printer, only
+// that buffer is kept in memory. In count mode they are not even looked at.
+// Returns false if there is no solution.
+static bool solve_grid(tkz_context *ctx, const t_grid *grid,
+                       const tkz_options *opts) {
+  // the solver log goes straight to the output, the solutions must too so
+  // that they stay in order
+  t_printer printer;
+  printer_init(&printer, sw.output_file, !sw.verbose);
+  tkz_solve(ctx, grid, opts, sw.count ? NULL : print_solution, &printer);
+  printer_free(&printer);
+  if (printer.error != 0) {
+    errx(EXIT_FAILURE, "ERROR -> could not write the solutions: %s",
+         strerror(printer.error));
+  }
+  exit_on_error(ctx);
+
+  print_count(sw.info_file, ctx->nb_solutions);
+  return ctx->nb_solutions > 0;
+}
+
+// Writes every grid of a file (text or binary) in the format of the command
+// line, text grids being separated by a blank line
+static void convert_grids(const char *filename) {
+  FILE *fd = open_input(filename);
+  tkz_context ctx;
+  tkz_context_init(&ctx);
+  t_grid grid;
+  long nb_grids = 0;
+  while (tkz_grid_read(&ctx, &grid, fd) != TKZ_ERROR_EMPTY || nb_grids == 0) {
+    exit_on_error(&ctx);
+    if (nb_grids > 0 && sw.format == FORMAT_TEXT) {
+      fprintf(sw.output_file, "\n");
+    }
+    write_grid(&grid, sw.output_file);
+    nb_grids++;
+  }
+  if (fd != stdin) {
+    fclose(fd);
+  }
+  if (sw.verbose) {
+    fprintf(sw.info_file, "%ld grids converted\n", nb_grids);
+  }
+}
+
+// Time since start in milliseconds
+static double elapsed_ms(const struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1e3 +
+         (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// Ends main with status, after printing the statistics of the run if asked.
+// They go to stderr in a fixed format so that tests/bench.sh can parse them:
+// nodes are those of the last solved grid (0 when nothing was solved), the
+// peak memory is the resident set of the whole process. The run fails if
+// its output could not be written.
+static int finish(const tkz_context *ctx, const struct timespec *start,
+                  int status) {
+  if (fflush(sw.output_file) != 0) {
+    warn("ERROR -> could not write the output");
+    status = EXIT_FAILURE;
+  } else if (ferror(sw.output_file)) {
+    warnx("ERROR -> could not write the output");
+    status = EXIT_FAILURE;
+  }
+  if (sw.stats) {
+    double ms = elapsed_ms(start);
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(stderr, "Stats: time %.3f ms, nodes %ld, peak memory %ld kB\n", ms,
+            ctx->nb_nodes, usage.ru_maxrss);
+  }
+  return status;
+}
+
 int main(int argc, char *argv[]) {
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
   sw.output_file = stdout;
   t_grid grid;
   sw.grid = &grid;
 
-  srand(time(NULL));
   parse_args(argc, argv);
 
+  sw.info_file = sw.format == FORMAT_TEXT ? sw.output_file : stderr;
+
+  if (!sw.seeded) {
+    // processes started in the same second still get different grids
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    sw.seed = ((uint64_t)now.tv_sec << 32) ^ (uint64_t)now.tv_nsec ^
+              ((uint64_t)getpid() << 16);
+  }
+
+  tkz_context ctx;
+  tkz_context_init(&ctx);
+  tkz_context_seed(&ctx, sw.seed, 0);
+  ctx.log = sw.verbose ? sw.info_file : NULL;
+  tkz_options opts;
+  cli_options(&opts);
+  if (sw.verbose) {
+    // what --seed needs to do the same random choices again
+    fprintf(sw.info_file, "Seed: %llu\n", (unsigned long long)sw.seed);
+  }
+
   if (sw.mode == SOLVER) {
     if (sw.verbose) {
-      fprintf(sw.output_file, "Solver mode detected\n");
+      fprintf(sw.info_file, "Solver mode detected\n");
     }
     if (argv[optind] == NULL) {
       errx(EXIT_FAILURE, "no input file to solve!");
     }
 
+    if (sw.batch) {
+      // a regular file is mapped, a pipe can only be read as a stream
+      bool solved;
+      struct stat st;
+      if (strcmp(argv[optind], "-") != 0 && stat(argv[optind], &st) == 0 &&
+          S_ISREG(st.st_mode)) {
+        tkz_corpus corpus;
+        tkz_corpus_open(&ctx, &corpus, argv[optind], sw.index_file);
+        exit_on_error(&ctx);
+        solved = batch_solve(NULL, &corpus, &opts, sw.threads);
+        tkz_corpus_close(&corpus);
+      } else {
+        FILE *fd = open_input(argv[optind]);
+        solved = batch_solve(fd, NULL, &opts, sw.threads);
+        if (fd != stdin) {
+          fclose(fd);
+        }
+      }
+      return finish(&ctx, &start, solved ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
     file_parser(sw.grid, argv[optind]);
 
     if (sw.verbose) {
-      fprintf(sw.output_file, "Parsed grid:\n");
-      grid_print(sw.grid, sw.output_file);
+      fprintf(sw.info_file, "Parsed grid:\n");
+      tkz_grid_write(sw.grid, sw.info_file);
     }
 
-    if (!grid_solver(sw.grid, mode)) {
-      return EXIT_FAILURE;
+    if (sw.cnf_file != NULL) {
+      FILE *fd = fopen(sw.cnf_file, "w");
+      if (fd == NULL) {
+        err(EXIT_FAILURE, "ERROR -> could not open '%s'", sw.cnf_file);
+      }
+      tkz_export_cnf(&ctx, sw.grid, fd);
+      fclose(fd);
+      exit_on_error(&ctx);
+      if (sw.verbose) {
+        fprintf(sw.info_file, "CNF written to %s\n", sw.cnf_file);
+      }
+    } else if (!solve_grid(&ctx, sw.grid, &opts)) {
+      return finish(&ctx, &start, EXIT_FAILURE);
     }
   } else if (sw.mode == GENERATOR) {
     if (sw.verbose) {
-      fprintf(sw.output_file, "Generator mode detected\n");
+      fprintf(sw.info_file, "Generator mode detected\n");
     }
-
-    grid_allocate(sw.grid, sw.grid_size);
-
-    if (sw.unique) {
-      fprintf(sw.output_file, "Unique mode detected\n");
-      generate_unique_grid(sw.grid, sw.percentage_fill);
-    } else {
-      generate_grid(sw.grid, sw.percentage_fill);
+    // the grids of a bulk generation are all the output, to be read back
+    if (sw.unique && sw.nb_puzzles == 0) {
+      fprintf(sw.info_file, "Unique mode detected\n");
     }
 
-    fprintf(sw.output_file, "Generated grid:\n");
-    grid_print(sw.grid, sw.output_file);
-  }
-
-  grid_free(sw.grid);
-  return EXIT_SUCCESS;
-}
-
-// Helper function
-int is_valid_size(int size) {
-  if (size == 4 || size == 8 || size == 16 || size == 32 || size == 64) {
-    return true;
-  }
-  return false;
-}
-
-// Allocate memory for a t_grid structure
-// Will exit the program if the size is invalid
-void grid_allocate(t_grid *g, int size) {
-  if (is_valid_size(size) == false) {
-    errx(EXIT_FAILURE, "invalid grid size for allocation !");
-  }
-
-  g->size = size;
-  g->grid = calloc(g->size, sizeof(char *));
-  for (int i = 0; i < g->size; i++) {
-    g->grid[i] = calloc(g->size, sizeof(char));
-  }
-
-  // Initialize grid with '_'
-  for (int i = 0; i < g->size; i++) {
-    for (int j = 0; j < g->size; j++) {
-      g->grid[i][j] = '_';
+    if (sw.nb_puzzles > 0) {
+      bool generated =
+          bulk_generate(sw.nb_puzzles, sw.grid_size, sw.percentage_fill,
+                        sw.unique, &opts, sw.threads, sw.seed);
+      return finish(&ctx, &start, generated ? EXIT_SUCCESS : EXIT_FAILURE);
     }
-  }
-}
 
-// Free memory allocated for a t_grid structure
-void grid_free(t_grid *g) {
-  if (g == NULL || g->grid == NULL) {
-    return;
-  }
+    tkz_generate(&ctx, sw.grid, sw.grid_size, sw.percentage_fill, sw.unique,
+                 &opts);
+    exit_on_error(&ctx);
 
-  for (int i = 0; i < g->size; i++) {
-    free(g->grid[i]);
+    fprintf(sw.info_file, "Generated grid:\n");
+    write_grid(sw.grid, sw.output_file);
+  } else if (sw.mode == CONVERTER) {
+    convert_grids(argv[optind]);
   }
-  free(g->grid);
-}
 
-// Prints a grid to sw.output_file
-// (stdout if no -o option has been given)
-void grid_print(const t_grid *g, FILE *fd) {
-  for (int i = 0; i < g->size; i++) {
-    for (int j = 0; j < g->size; j++) {
-      fprintf(fd, "%c", g->grid[i][j]);
-    }
-    fprintf(fd, "\n");
-  }
-}
-// Check if a character is a valid takuzu grid character
-bool check_char(char c) {
-  if (c == '0' || c == '1' || c == '_') {
-    return true;
-  }
-  return false;
+  return finish(&ctx, &start, EXIT_SUCCESS);
 }
 
-// The parser must be able to read a grid of size 4 to 64 with only one scan
-// of the file. The scanner has to be as robust as possible when a user
-// provides an incorrect grid
-//    file.A meaningful error message must be issued in these situations,
-//    all dynamically allocated memory has to be freed and the program has to
-//        stop and return EXIT_FAILURE
-void file_parser(t_grid *grid, char *filename) {
-  if (sw.verbose) {
-    fprintf(sw.output_file, "Parsing file: %s\n", filename);
+// Opens a file to read grids from, "-" for the standard input. Stops the
+// program if the file can't be opened.
+FILE *open_input(const char *filename) {
+  if (strcmp(filename, "-") == 0) {
+    return stdin;
   }
 
   FILE *fd = fopen(filename, "r");
@@ -165,105 +295,76 @@ void file_parser(t_grid *grid, char *filename) {
         exit(EXIT_FAILURE);
     }
   }
+  return fd;
+}
 
-  char read;
-  char line[MAX_GRID_SIZE];
-  int lineSize = 0;
-
-  // Read the first line to get the grid size
-  while ((read = fgetc(fd)) != '\n') {
-    switch (read) {
-      case '#':
-        while ((read = fgetc(fd)) != '\n') {
-          if (read == EOF) {
-            fclose(fd);
-            fprintf(stderr, "ERROR -> empty file!\n");
-            exit(EXIT_FAILURE);
-          }
-        }
-        break;
-
-      case EOF:
-        fclose(fd);
-        fprintf(stderr, "ERROR -> empty file!\n");
-        exit(EXIT_FAILURE);
-        break;
-
-      // Start of the first line
-      default:
-        if (check_char(read)) {
-          line[lineSize] = read;
-          lineSize++;
-        } else if (read == ' ' || read == '\t') {
-          // ignore and skip
-        } else {
-          fclose(fd);
-          fprintf(stderr, "ERROR -> invalid character!\n");
-          exit(EXIT_FAILURE);
-        }
-        break;
-    }
-  }
-
-  if (is_valid_size(lineSize) == false) {
-    fprintf(stderr,
-            "ERROR -> Invalid size, %d is not in the valid sizes %d, %d, %d, "
-            "%d, %d!\n",
-            lineSize, 4, 8, 16, 32, 64);
+// Reads the first grid of a file with tkz_grid_read, or with --grid the grid
+// of that number in the mapped file. The scanner has to be as robust as
+// possible when a user provides an incorrect grid file: a meaningful error
+// message is issued and the program stops and returns EXIT_FAILURE
+void file_parser(t_grid *grid, char *filename) {
+  if (sw.verbose) {
+    fprintf(sw.info_file, "Parsing file: %s\n", filename);
   }
 
-  // At this point lineSize is equal to the length of the first line (and be a
-  // valid size too)
-  grid_allocate(grid, lineSize);
-
-  for (int i = 0; i < lineSize; i++) {
-    grid->grid[0][i] = line[i];
+  tkz_context ctx;
+  tkz_context_init(&ctx);
+  if (sw.grid_number > 0) {
+    tkz_corpus corpus;
+    tkz_corpus_open(&ctx, &corpus, filename, sw.index_file);
+    exit_on_error(&ctx);
+    tkz_corpus_grid(&ctx, &corpus, sw.grid_number - 1, grid);
+    tkz_corpus_close(&corpus);
+    exit_on_error(&ctx);
+    return;
   }
 
-  int currentRow = 1;  // 1 because we already read the first line
-  int currentColumn = 0;
-
-  while ((read = fgetc(fd)) != EOF) {
-    if (read == '\n') {
-      // not enough chars
-      if (currentColumn != lineSize) {
-        grid_free(grid);
-        fclose(fd);
-        fprintf(stderr, "ERROR -> inconsistent number of char by row!\n");
-        exit(EXIT_FAILURE);
-      }
-      currentRow++;
-      currentColumn = 0;
-    } else {
-      // too much chars
-      if (currentColumn == lineSize) {
-        grid_free(grid);
-        fclose(fd);
-        fprintf(stderr, "ERROR -> inconsistent number of char by row!\n");
-        exit(EXIT_FAILURE);
-      }
-      if (check_char(read)) {
-        grid->grid[currentRow][currentColumn] = read;
-        currentColumn++;
-      } else if (read == ' ' || read == '\t') {
-        // ignore and skip
-      } else {
-        grid_free(grid);
-        fclose(fd);
-        fprintf(stderr, "ERROR -> invalid character!\n");
-        exit(EXIT_FAILURE);
-      }
-    }
+  FILE *fd = open_input(filename);
+  tkz_grid_read(&ctx, grid, fd);
+  if (fd != stdin) {
+    fclose(fd);
   }
-  fclose(fd);
+  exit_on_error(&ctx);
 }
 
+// Codes of the options that only have a long form
+enum {
+  OPT_BATCH = 256,
+  OPT_CONVERT,
+  OPT_COUNT_PUZZLES,
+  OPT_EXPORT_CNF,
+  OPT_FORMAT,
+  OPT_GRID,
+  OPT_INDEX,
+  OPT_NO_SYMMETRY,
+  OPT_SAT_SOLVER,
+  OPT_SEED,
+  OPT_STATS
+};
+
 void parse_args(int argc, char **argv) {
   static struct option parse_structure[] = {
       {"all", no_argument, 0, 'a'},
+      {"batch", no_argument, 0, OPT_BATCH},
+      {"branching", required_argument, 0, 'b'},
+      {"convert", no_argument, 0, OPT_CONVERT},
+      {"count", no_argument, 0, 'c'},
+      {"count-puzzles", required_argument, 0, OPT_COUNT_PUZZLES},
+      {"engine", required_argument, 0, 'e'},
+      {"export-cnf", required_argument, 0, OPT_EXPORT_CNF},
+      {"format", required_argument, 0, OPT_FORMAT},
       {"generate", optional_argument, 0, 'g'},
+      {"grid", required_argument, 0, OPT_GRID},
+      {"index", required_argument, 0, OPT_INDEX},
+      {"jobs", required_argument, 0, 'j'},
+      {"limit", required_argument, 0, 'k'},
+      {"lookahead", required_argument, 0, 'l'},
       {"output", required_argument, 0, 'o'},
       {"number", required_argument, 0, 'N'},
+      {"no-symmetry", no_argument, 0, OPT_NO_SYMMETRY},
+      {"sat-solver", required_argument, 0, OPT_SAT_SOLVER},
+      {"seed", required_argument, 0, OPT_SEED},
+      {"stats", no_argument, 0, OPT_STATS},
       {"unique", no_argument, 0, 'u'},
       {"verbose", no_argument, 0, 'v'},
       {"help", no_argument, 0, 'h'},
@@ -271,11 +372,11 @@ void parse_args(int argc, char **argv) {
 
   int opt;
 
-  while ((opt = getopt_long(argc, argv, "ag:N:o:uvh", parse_structure, NULL)) !=
+  while ((opt = getopt_long(argc, argv, "ab:ce:g:j:k:l:N:o:uvh", parse_structure, NULL)) !=
          -1) {
     switch (opt) {
       case 'a':
-        if (sw.mode == GENERATOR) {
+        if (sw.mode == GENERATOR || sw.mode == CONVERTER) {
           errx(EXIT_FAILURE, "ERRROR -> invalid option combination!");
         }
 
@@ -284,15 +385,53 @@ void parse_args(int argc, char **argv) {
         mode = MODE_ALL;
         break;
 
+      case 'c':
+        if (sw.mode == GENERATOR || sw.mode == CONVERTER) {
+          errx(EXIT_FAILURE, "ERROR -> invalid option combination!");
+        }
+
+        sw.mode = SOLVER;
+        sw.count = true;
+        mode = MODE_ALL;
+        break;
+
+      case 'b':
+        if (strcmp(optarg, "line") == 0) {
+          sw.branching = BRANCH_LINE;
+        } else if (strcmp(optarg, "balance") == 0) {
+          sw.branching = BRANCH_BALANCE;
+        } else if (strcmp(optarg, "propagation") == 0) {
+          sw.branching = BRANCH_PROPAGATION;
+        } else if (strcmp(optarg, "random") == 0) {
+          sw.branching = BRANCH_RANDOM;
+        } else {
+          fprintf(stderr, "ERROR -> unknown branching policy '%s'!\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case 'e':
+        if (strcmp(optarg, "backtrack") == 0) {
+          sw.engine = ENGINE_BACKTRACK;
+        } else if (strcmp(optarg, "cdcl") == 0) {
+          sw.engine = ENGINE_CDCL;
+        } else if (strcmp(optarg, "sat") == 0) {
+          sw.engine = ENGINE_SAT;
+        } else {
+          fprintf(stderr, "ERROR -> unknown solver engine '%s'!\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+
       case 'g':
-        if (sw.mode == SOLVER) {
+        if (sw.mode == SOLVER || sw.mode == CONVERTER) {
           errx(EXIT_FAILURE, "ERROR -> invalid option combination!");
         }
 
         sw.mode = GENERATOR;
         if (optarg != NULL) {
           int size = atoi(optarg);
-          if (is_valid_size(size) == false) {
+          if (!tkz_valid_size(size)) {
             fprintf(stderr,
                     "ERROR -> Invalid size, %d is not in the valid sizes %d, "
                     "%d, %d, %d, %d!\n",
@@ -306,8 +445,35 @@ void parse_args(int argc, char **argv) {
         }
         break;
 
+      case 'j':
+        sw.threads = atoi(optarg);
+        if (sw.threads < 1) {
+          fprintf(stderr, "ERROR -> invalid number of threads '%s'!\n",
+                  optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case 'k':
+        sw.limit = atol(optarg);
+        if (sw.limit < 1) {
+          fprintf(stderr, "ERROR -> invalid solution limit '%s'!\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case 'l':
+        if (strcmp(optarg, "0") == 0 || strcmp(optarg, "1") == 0 ||
+            strcmp(optarg, "2") == 0) {
+          sw.lookahead = optarg[0] - '0';
+        } else {
+          fprintf(stderr, "ERROR -> invalid lookahead level '%s'!\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+
       case 'N':
-        if (sw.mode == SOLVER) {
+        if (sw.mode == SOLVER || sw.mode == CONVERTER) {
           errx(EXIT_FAILURE, "ERROR -> invalid option combination!");
         }
         // We don't set the mode to GENERATOR so that it will error out if
@@ -334,7 +500,7 @@ void parse_args(int argc, char **argv) {
         break;
 
         case 'u':
-          if (sw.mode == SOLVER) {
+          if (sw.mode == SOLVER || sw.mode == CONVERTER) {
             errx(EXIT_FAILURE, "ERROR -> invalid option combination!");
           }
 
@@ -345,6 +511,100 @@ void parse_args(int argc, char **argv) {
           sw.verbose = true;
           break;
 
+        case OPT_BATCH:
+          if (sw.mode == GENERATOR || sw.mode == CONVERTER) {
+            errx(EXIT_FAILURE, "ERROR -> invalid option combination!");
+          }
+
+          sw.mode = SOLVER;
+          sw.batch = true;
+          break;
+
+        case OPT_CONVERT:
+          if (sw.mode != NONE) {
+            errx(EXIT_FAILURE, "ERROR -> invalid option combination!");
+          }
+
+          sw.mode = CONVERTER;
+          break;
+
+        case OPT_COUNT_PUZZLES:
+          if (sw.mode == SOLVER || sw.mode == CONVERTER) {
+            errx(EXIT_FAILURE, "ERROR -> invalid option combination!");
+          }
+          // Like -N, it errors out if there is no -g option
+          sw.nb_puzzles = atol(optarg);
+          if (sw.nb_puzzles < 1) {
+            fprintf(stderr, "ERROR -> invalid number of puzzles '%s'!\n",
+                    optarg);
+            exit(EXIT_FAILURE);
+          }
+          break;
+
+        case OPT_SEED: {
+          char *end;
+          errno = 0;
+          sw.seed = strtoull(optarg, &end, 0);
+          if (errno != 0 || end == optarg || *end != '\0') {
+            fprintf(stderr, "ERROR -> invalid seed '%s'!\n", optarg);
+            exit(EXIT_FAILURE);
+          }
+          sw.seeded = true;
+          break;
+        }
+
+        case OPT_STATS:
+          sw.stats = true;
+          break;
+
+        case OPT_FORMAT:
+          if (strcmp(optarg, "text") == 0) {
+            sw.format = FORMAT_TEXT;
+          } else if (strcmp(optarg, "line") == 0) {
+            sw.format = FORMAT_LINE;
+          } else if (strcmp(optarg, "bin") == 0) {
+            sw.format = FORMAT_BIN;
+          } else {
+            fprintf(stderr, "ERROR -> unknown grid format '%s'!\n", optarg);
+            exit(EXIT_FAILURE);
+          }
+          break;
+
+        case OPT_GRID:
+          if (sw.mode == GENERATOR || sw.mode == CONVERTER) {
+            errx(EXIT_FAILURE, "ERROR -> invalid option combination!");
+          }
+
+          sw.mode = SOLVER;
+          sw.grid_number = atol(optarg);
+          if (sw.grid_number < 1) {
+            fprintf(stderr, "ERROR -> invalid grid number '%s'!\n", optarg);
+            exit(EXIT_FAILURE);
+          }
+          break;
+
+        case OPT_INDEX:
+          sw.index_file = optarg;
+          break;
+
+        case OPT_EXPORT_CNF:
+          if (sw.mode == GENERATOR || sw.mode == CONVERTER) {
+            errx(EXIT_FAILURE, "ERROR -> invalid option combination!");
+          }
+
+          sw.mode = SOLVER;
+          sw.cnf_file = optarg;
+          break;
+
+        case OPT_NO_SYMMETRY:
+          sw.symmetry = false;
+          break;
+
+        case OPT_SAT_SOLVER:
+          sw.engine = ENGINE_SAT;
+          sw.sat_solver = optarg;
+          break;
+
         case 'h':
           usage();
           exit(EXIT_SUCCESS);
@@ -360,9 +620,18 @@ void parse_args(int argc, char **argv) {
   // Incompatibility checks
   if (argv[optind] == NULL && sw.mode == SOLVER) {
     errx(EXIT_FAILURE, "ERROR -> no input file to solve!");
+  } else if (argv[optind] == NULL && sw.mode == CONVERTER) {
+    errx(EXIT_FAILURE, "ERROR -> no input file to convert!");
   } else if (argv[optind] != NULL && sw.mode == GENERATOR) {
     errx(EXIT_FAILURE, "ERROR -> invalid option combination!");
-  } else if (sw.unique && (sw.mode != GENERATOR)) {
+  } else if ((sw.unique || sw.nb_puzzles > 0) && sw.mode != GENERATOR) {
+    errx(EXIT_FAILURE, "ERROR -> invalid option combination!");
+  } else if (sw.engine != ENGINE_BACKTRACK && sw.threads > 1 && !sw.batch &&
+             sw.nb_puzzles == 0) {
+    errx(EXIT_FAILURE, "ERROR -> invalid option combination!");
+  } else if (sw.batch && (sw.cnf_file != NULL || sw.grid_number > 0)) {
+    errx(EXIT_FAILURE, "ERROR -> invalid option combination!");
+  } else if (sw.index_file != NULL && !sw.batch && sw.grid_number == 0) {
     errx(EXIT_FAILURE, "ERROR -> invalid option combination!");
   }
 
@@ -378,12 +647,72 @@ void parse_args(int argc, char **argv) {
 }
 
 void usage() {
-  printf("Usage: takuzu [-a|-o FILE|-v|-h] FILE\n");
-  printf("       takuzu -g[SIZE] [-u|-o FILE|-v|-h]\n");
+  printf(
+      "Usage: takuzu [-a|-c|-k K|-e ENGINE|-b POLICY|-l LEVEL|-j N|-o FILE|"
+      "-v|-h] "
+      "FILE\n");
+  printf("       takuzu -g[SIZE] [-u|--seed S|-o FILE|-v|-h]\n");
+  printf(
+      "       takuzu -g[SIZE] --count-puzzles N [-u|-N PCT|-j N|--seed S|"
+      "-o FILE]\n");
+  printf(
+      "       takuzu --batch [-a|-c|-k K|-e ENGINE|-j N|--index INDEX|-o "
+      "FILE] FILE\n");
+  printf("       takuzu --grid N [--index INDEX] [-a|-c|...] FILE\n");
+  printf("       takuzu --export-cnf CNF FILE\n");
+  printf("       takuzu --convert [--format FORMAT|-o FILE] FILE\n");
   printf("Solve or generate takuzu grids of size: 4, 8 16, 32, 64\n");
+  printf("FILE is - to read the grid from the standard input, its grids\n");
+  printf("are text or binary (see --format)\n");
   printf("  -a, --all               search for all possible solutions\n");
+  printf("  --batch                 solve every grid of FILE (separated by\n");
+  printf("                          blank or '#' lines) and report each one\n");
+  printf("                          in input order, -j N solves N grids at\n");
+  printf("                          a time\n");
+  printf("  --grid N                solve the Nth grid of FILE (from 1)\n");
+  printf("  --index INDEX           offsets of the grids of FILE, for\n");
+  printf("                          --batch and --grid: read from INDEX if\n");
+  printf("                          it is up to date, otherwise computed and\n");
+  printf("                          saved to INDEX\n");
+  printf("  -c, --count             only count the solutions\n");
+  printf("  --count-puzzles N       generate N distinct grids, -j N\n");
+  printf("                          generates N at a time\n");
+  printf("  --convert               write every grid of FILE in the format\n");
+  printf("                          of --format\n");
+  printf("  --format FORMAT         format of the grids written: text\n");
+  printf("                          (default), line (a grid per line) or\n");
+  printf("                          bin (2 bits per cell), the messages of\n");
+  printf("                          line and bin go to the standard error\n");
+  printf("  -k K, --limit K         stop after K solutions (with -a or -c)\n");
+  printf("  --no-symmetry           with -c, visit every solution instead of\n");
+  printf("                          one per orbit of the grid's symmetries\n");
+  printf("  -e ENGINE, --engine ENGINE\n");
+  printf("                          search algorithm: backtrack (default) or\n");
+  printf("                          cdcl (clause learning, for large grids)\n");
+  printf("                          or sat (external SAT solver)\n");
+  printf("  --sat-solver BIN        SAT solver of -e sat (default: first of\n");
+  printf("                          kissat, cadical, cryptominisat5 on PATH)\n");
+  printf("  --export-cnf FILE       write the grid as DIMACS CNF to FILE\n");
+  printf("                          instead of solving it\n");
+  printf("  -b POLICY, --branching POLICY\n");
+  printf("                          how the solver picks the cell to try:\n");
+  printf("                          line (default), balance, propagation or\n");
+  printf("                          random\n");
   printf("  -g[N], --generate[=N]   generate a grid of size NxN (default:8)\n");
+  printf("  -N PCT, --number PCT    percentage of the cells a generated grid\n");
+  printf("                          gives (default: 20), with -u as few as\n");
+  printf("                          possible down to PCT\n");
+  printf("  -j N, --jobs N          solve with N threads (default: 1)\n");
+  printf("  -l LEVEL, --lookahead LEVEL\n");
+  printf("                          probe cells before branching: 0 (none,\n");
+  printf("                          default), 1 or 2 (double lookahead)\n");
   printf("  -o FILE, --output FILE  write output to FILE\n");
+  printf("  --seed S                seed of the generated grids and of\n");
+  printf("                          -b random: the same seed gives the same\n");
+  printf("                          grids and searches (default: from the\n");
+  printf("                          clock, printed by -v)\n");
+  printf("  --stats                 print the time, search nodes and peak\n");
+  printf("                          memory of the run to the standard error\n");
   printf("  -u, --unique            generate a grid with unique solution\n");
   printf("  -v, --verbose           verbose output\n");
   printf("  -h, --help              display this help and exit\n");
@@ -0,0 +1,45 @@
+// Checks the numbers the library returns, which the exit codes of
+// tests/test.sh can't tell. Prints a line per check, fails if one fails.
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libtakuzu.h"
+
+static int nb_failed = 0;
+
+// Solves an empty grid of the given size without callback and compares the
+// number of solutions found with expected
+static void check_count(const char *name, int size, t_mode mode, long limit,
+                        int threads, long expected) {
+  tkz_context ctx;
+  tkz_context_init(&ctx);
+  t_grid grid;
+  tkz_grid_init(&ctx, &grid, size);
+  tkz_options opts;
+  tkz_options_init(&opts);
+  opts.mode = mode;
+  opts.limit = limit;
+  opts.threads = threads;
+  tkz_solve(&ctx, &grid, &opts, NULL, NULL);
+  if (ctx.status != TKZ_OK || ctx.nb_solutions != expected) {
+    printf("- ✗ %s: %ld solutions, expected %ld\n", name, ctx.nb_solutions,
+           expected);
+    nb_failed++;
+  } else {
+    printf("- ✓ %s\n", name);
+  }
+}
+
+int main(void) {
+  check_count("first solution of an empty 4x4", 4, MODE_FIRST, 0, 1, 1);
+  check_count("first solution of an empty 8x8", 8, MODE_FIRST, 0, 1, 1);
+  check_count("first solution of an empty 8x8, 3 threads", 8, MODE_FIRST, 0,
+              3, 1);
+  check_count("count of an empty 4x4", 4, MODE_ALL, 0, 1, 72);
+  check_count("count of an empty 4x4, 3 threads", 4, MODE_ALL, 0, 3, 72);
+  check_count("count of an empty 8x8 up to 5", 8, MODE_ALL, 5, 1, 5);
+  check_count("count of an empty 8x8 up to 5, 3 threads", 8, MODE_ALL, 5, 3,
+              5);
+  return nb_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,220 @@
+#!/bin/bash
+# shellcheck disable=SC2086
+#
+# Benchmark of the solver and the generator on the graded corpus of
+# tests/bench (5 unique puzzles per size and grade: easy keeps 50% of the
+# cells, medium 35%, hard as few as the generator can).
+#
+#   tests/bench.sh [-r REPS] [-w WARMUP] [-t SECONDS] [-e "ENGINES"]
+#                  [-o FILE] [-b BASELINE] [-p PCT]
+#   tests/bench.sh corpus
+#
+# Every puzzle is solved WARMUP times unmeasured then REPS times measured, in
+# each mode (first solution, all solutions, count) with each engine, and
+# unique grids of every size are generated the same way. The
+# numbers come from --stats: the time is measured inside the process (no
+# process start), nodes are those of the search, the memory is the peak
+# resident set. A run slower than the timeout stops its cell, which is
+# reported as a timeout instead of a result.
+#
+# Results are written as CSV to FILE (default: bench_results.csv). With a
+# baseline (a previous FILE), a cell whose median got more than PCT percent
+# (default: 10) slower, or that no longer finishes, fails the benchmark.
+
+root_path=$( cd "$(dirname "$(dirname "${BASH_SOURCE[0]}")")" || exit ; pwd -P )
+takuzu="$root_path/bin/takuzu"
+corpus_path="$root_path/tests/bench"
+stats_file="/tmp/takuzu_bench_stats"
+samples_file="/tmp/takuzu_bench_samples"
+
+sizes=(4 8 16 32 64)
+grades=("easy" "medium" "hard")
+# -N of the generator for each grade
+fills=(50 35 0)
+modes=("first" "all" "count")
+mode_flags=("" "-a" "-c")
+
+reps=5
+warmup=1
+timeout_s=10
+engines="backtrack cdcl"
+output="bench_results.csv"
+baseline=""
+tolerance=10
+
+# Regenerates the corpus, the seeds make it the same every time for a given
+# generator
+if [ "$1" == "corpus" ]; then
+  mkdir -p "$corpus_path"
+  for size in "${sizes[@]}"; do
+    for g in "${!grades[@]}"; do
+      file="$corpus_path/${size}_${grades[$g]}"
+      if ! "$takuzu" -g $size -u -N ${fills[$g]} --count-puzzles 5 \
+          --seed $((size * 10 + g)) > "$file"; then
+        echo "ERROR -> could not generate $file" >&2
+        exit 1
+      fi
+    done
+  done
+  exit 0
+fi
+
+while getopts "r:w:t:e:o:b:p:" opt; do
+  case $opt in
+    r) reps=$OPTARG ;;
+    w) warmup=$OPTARG ;;
+    t) timeout_s=$OPTARG ;;
+    e) engines=$OPTARG ;;
+    o) output=$OPTARG ;;
+    b) baseline=$OPTARG ;;
+    p) tolerance=$OPTARG ;;
+    *) exit 1 ;;
+  esac
+done
+
+if [ ! -x "$takuzu" ]; then
+  echo "ERROR -> $takuzu not found, build it with make" >&2
+  exit 1
+fi
+if [ "$reps" -lt 1 ]; then
+  echo "ERROR -> invalid number of repetitions '$reps'" >&2
+  exit 1
+fi
+if [ -n "$baseline" ] && [ ! -r "$baseline" ]; then
+  echo "ERROR -> baseline '$baseline' not found" >&2
+  exit 1
+fi
+
+# Runs takuzu with the given arguments and --stats. Sets run_ms, run_nodes and
+# run_rss, returns 0 on success, 124 on timeout, 1 on any other failure.
+run() {
+  timeout "$timeout_s" "$takuzu" "$@" --stats > /dev/null 2> "$stats_file"
+  local status=$?
+  if [ $status -eq 124 ]; then
+    return 124
+  fi
+  read -r run_ms run_nodes run_rss < <(sed -n \
+    's/^Stats: time \([0-9.]*\) ms, nodes \([0-9]*\), peak memory \([0-9]*\) kB$/\1 \2 \3/p' \
+    "$stats_file")
+  if [ $status -ne 0 ] || [ -z "$run_ms" ]; then
+    return 1
+  fi
+  return 0
+}
+
+# Runs a cell: warmup then measured runs of every argument list of the
+# array named by $1 (one list per puzzle). Leaves the times in samples_file
+# and sets cell_status, cell_runs, cell_nodes (sum) and cell_rss (max).
+run_cell() {
+  local -n runs_args=$1
+  : > "$samples_file"
+  cell_status="ok"
+  cell_runs=0
+  cell_nodes=0
+  cell_rss=0
+  for args in "${runs_args[@]}"; do
+    for ((k = 0; k < warmup + reps; k++)); do
+      run $args
+      case $? in
+        0) ;;
+        124) cell_status="timeout"; return ;;
+        *) cell_status="error"; return ;;
+      esac
+      if [ $k -ge "$warmup" ]; then
+        echo "$run_ms" >> "$samples_file"
+        cell_runs=$((cell_runs + 1))
+        cell_nodes=$((cell_nodes + run_nodes))
+        if [ "$run_rss" -gt "$cell_rss" ]; then
+          cell_rss=$run_rss
+        fi
+      fi
+    done
+  done
+}
+
+# Writes a CSV line and a table line for the last cell
+report() {
+  local engine=$1 size=$2 grade=$3 mode=$4
+  local median="" p99="" nodes_per_s=""
+  if [ "$cell_status" == "ok" ]; then
+    # nearest rank percentiles of the sorted times
+    read -r median p99 total < <(sort -n "$samples_file" | awk '
+      { t[NR] = $1; sum += $1 }
+      END {
+        median = NR % 2 ? t[(NR + 1) / 2] : (t[NR / 2] + t[NR / 2 + 1]) / 2
+        rank = int(0.99 * NR); if (rank < 0.99 * NR) rank++
+        printf "%.3f %.3f %.3f\n", median, t[rank], sum
+      }')
+    if [ "$cell_nodes" -gt 0 ]; then
+      nodes_per_s=$(awk -v n="$cell_nodes" -v ms="$total" \
+        'BEGIN { printf "%.0f", (ms > 0 ? n * 1000 / ms : 0) }')
+    fi
+  fi
+  echo "$engine,$size,$grade,$mode,$cell_status,$cell_runs,$median,$p99,$nodes_per_s,$cell_rss" >> "$output"
+  printf "%-10s %4s %-7s %-9s %-8s %5s %12s %12s %14s %10s\n" "$engine" \
+    "$size" "$grade" "$mode" "$cell_status" "$cell_runs" "$median" "$p99" \
+    "$nodes_per_s" "$cell_rss"
+}
+
+echo "engine,size,grade,mode,status,runs,median_ms,p99_ms,nodes_per_s,peak_rss_kb" > "$output"
+printf "%-10s %4s %-7s %-9s %-8s %5s %12s %12s %14s %10s\n" "engine" "size" \
+  "grade" "mode" "status" "runs" "median_ms" "p99_ms" "nodes_per_s" "rss_kb"
+
+failed=0
+for engine in $engines; do
+  for size in "${sizes[@]}"; do
+    for grade in "${grades[@]}"; do
+      file="$corpus_path/${size}_$grade"
+      nb_puzzles=$(sed -n 's/^# Puzzles: \([0-9]*\),.*/\1/p' "$file")
+      for m in "${!modes[@]}"; do
+        cell=()
+        for ((n = 1; n <= nb_puzzles; n++)); do
+          cell+=("-e $engine ${mode_flags[$m]} --grid $n $file")
+        done
+        run_cell cell
+        report "$engine" "$size" "$grade" "${modes[$m]}"
+        [ "$cell_status" == "error" ] && failed=1
+      done
+    done
+  done
+done
+
+# Unique generation, 5 seeds playing the part of the puzzles: a seed always
+# makes the same grid, so the runs are as comparable as the solver's
+for size in "${sizes[@]}"; do
+  cell=()
+  for ((n = 1; n <= 5; n++)); do
+    cell+=("-g $size -u --seed $((size * 10 + n))")
+  done
+  run_cell cell
+  report "generator" "$size" "unique" "generate"
+  [ "$cell_status" == "error" ] && failed=1
+done
+
+echo "Results written to $output"
+
+# Cells slower than the baseline (or that stopped finishing)
+if [ -n "$baseline" ]; then
+  regressions=$(awk -F, -v tol="$tolerance" '
+    FNR == 1 { next }
+    NR == FNR { key = $1 "," $2 "," $3 "," $4; status[key] = $5; median[key] = $7; next }
+    {
+      key = $1 "," $2 "," $3 "," $4
+      if (!(key in status) || status[key] != "ok") next
+      if ($5 != "ok") {
+        print key ": " $5 " (baseline " median[key] " ms)"
+      } else if ($7 > median[key] * (1 + tol / 100)) {
+        printf "%s: %s ms (baseline %s ms, +%.1f%%)\n", key, $7, median[key],
+          (median[key] > 0 ? ($7 / median[key] - 1) * 100 : 0)
+      }
+    }' "$baseline" "$output")
+  if [ -n "$regressions" ]; then
+    echo "Regressions over $tolerance% against $baseline:"
+    echo "$regressions"
+    failed=1
+  else
+    echo "No regression over $tolerance% against $baseline"
+  fi
+fi
+
+[ $failed -eq 0 ]
@@ -1,9 +1,10 @@
 #!/bin/bash
-# shellcheck disable=SC2181
+# shellcheck disable=SC2181,SC2086
 
 root_path=$( cd "$(dirname "$(dirname "${BASH_SOURCE[0]}")")" || exit ; pwd -P )
 takuzu="$root_path/bin/takuzu"
 takuzu_debug="$root_path/bin/takuzu_debug"
+api_test="$root_path/bin/api_test"
 log_file="/tmp/valgrind_takuzu"
 
 normal_test=(
@@ -13,6 +14,8 @@ normal_test=(
   "-g 16 -N 40"
   "-g 32"
   "-g 4 -u"
+  "-g 32 -u"
+  "-g 16 -u -N 40"
   "tests/solver/heuristic"
   "tests/solver/easy"
   "tests/solver/medium"
@@ -20,6 +23,35 @@ normal_test=(
   "tests/solver/onesolution_2"
   "tests/solver/sevensolutions"
   "tests/solver/empty_4"
+  "-b balance tests/solver/sevensolutions"
+  "-b propagation tests/solver/onesolution_1"
+  "-b random -a tests/solver/sevensolutions"
+  "-b random -a -j 2 --seed 7 tests/solver/sevensolutions"
+  "-j 4 -a tests/solver/sevensolutions"
+  "-j 2 tests/solver/medium"
+  "-c tests/solver/sevensolutions"
+  "-c tests/solver/empty_4"
+  "-c --no-symmetry tests/solver/empty_4"
+  "-c -k 2 tests/solver/empty_8"
+  "-a -k 3 tests/solver/sevensolutions"
+  "-c -j 3 tests/solver/empty_4"
+  "-l 1 -a tests/solver/sevensolutions"
+  "-l 2 tests/solver/onesolution_1"
+  "-e cdcl -a tests/solver/sevensolutions"
+  "-e cdcl tests/solver/large_64"
+  "--export-cnf /tmp/takuzu_test.cnf tests/solver/medium"
+  "--batch tests/solver/batch"
+  "--batch -c -j 2 tests/solver/batch"
+  "--grid 2 tests/solver/batch"
+  "--grid 3 -c --index /tmp/takuzu_test.idx tests/solver/batch"
+  "-a tests/solver/sevensolutions.tkb"
+  "-a --format bin -o /tmp/takuzu_test.tkb tests/solver/sevensolutions"
+  "--convert --format bin -o /tmp/takuzu_test.tkb tests/solver/batch"
+  "-a --format line tests/solver/empty_4"
+  "-g 8 --seed 42"
+  "--stats -c tests/solver/empty_4"
+  "-g 8 -u --count-puzzles 20 -j 2 --seed 1"
+  "-g 16 --count-puzzles 5 --format bin -o /tmp/takuzu_test.tkb"
 )
 
 failure_tests=(
@@ -30,7 +62,43 @@ failure_tests=(
   "-g 214748364772391" # Bigger than INT_MAX
   "tests/solver/nosolution"
   "tests/solver/invalid"
+  "tests/solver/duplicate_rows"
   "tests/solver/severalsolutions -u"
+  "-b foo tests/solver/easy" # Unknown branching policy
+  "-j 0 tests/solver/easy" # Invalid number of threads
+  "-c tests/solver/nosolution"
+  "-c -k 0 tests/solver/easy" # Invalid limit
+  "-c -g 8" # Invalid combination
+  "-l 3 tests/solver/easy" # Invalid lookahead level
+  "-l 1 tests/solver/nosolution"
+  "-e foo tests/solver/easy" # Unknown solver engine
+  "-e cdcl -j 2 tests/solver/easy" # Invalid combination
+  "-e cdcl tests/solver/nosolution"
+  "--export-cnf /tmp/takuzu_test.cnf -g 8" # Invalid combination
+  "--sat-solver /nonexistent tests/solver/easy" # No such SAT solver
+  "--batch -e sat -j 4 --sat-solver tests/unsat_solver.sh tests/solver/batch" # No solution, must not hang
+  "--batch tests/solver/nosolution"
+  "--batch -g 8" # Invalid combination
+  "--grid 4 tests/solver/batch" # No such grid
+  "--index /tmp/takuzu_test.idx tests/solver/easy" # Invalid combination
+  "--format foo tests/solver/easy" # Unknown grid format
+  "--convert -a tests/solver/easy" # Invalid combination
+  "-a -o /dev/full tests/solver/sevensolutions" # Output not written
+  "-g 4 --count-puzzles 5 -o /dev/full" # Output not written
+  "--count-puzzles 5" # Invalid combination
+  "-g 8 --count-puzzles 0" # Invalid number of puzzles
+  "-g 4 -N 100 --count-puzzles 100" # Only 72 full 4x4 grids
+  "-g 8 --seed foo" # Invalid seed
+)
+
+# Arguments and the number of solutions they must print
+count_tests=(
+  "-c tests/solver/empty_4:72"
+  "-c --no-symmetry tests/solver/empty_4:72"
+  "-c -j 3 tests/solver/empty_4:72"
+  "-c tests/solver/sevensolutions:7"
+  "-c -k 2 tests/solver/empty_8:2"
+  "-c -k 5 -j 3 tests/solver/empty_8:5"
 )
 
 success_tests=()
@@ -41,7 +109,7 @@ bad_valgrind=()
 
 if [ "$1" == "debug" ]; then
   for i in "${normal_test[@]}"; do
-    $takuzu "$i" &> /dev/null
+    $takuzu $i &> /dev/null
     if [ $? -ne 0 ]; then
       echo "- ✗ $i"
       failed_tests+=("$i")
@@ -51,7 +119,7 @@ if [ "$1" == "debug" ]; then
     fi
 
     # Grepping directly does not work so we need to use a temporary file
-    valgrind --leak-check=full --show-leak-kinds=all --track-origins=yes --log-file=$log_file "$takuzu_debug" "$i" &> /dev/null
+    valgrind --leak-check=full --show-leak-kinds=all --track-origins=yes --log-file=$log_file "$takuzu_debug" $i &> /dev/null
     val_res="$(cat $log_file | grep "LEAK SUMMARY" -A5)"
     if [ "$val_res" == "" ]; then
       good_valgrind+=("$i")
@@ -61,7 +129,7 @@ if [ "$1" == "debug" ]; then
   done
 
   for i in "${failure_tests[@]}"; do
-    $takuzu "$i" &> /dev/null
+    $takuzu $i &> /dev/null
     if [ $? -eq 0 ]; then
       echo "- ✗ $i"
       failed_tests+=("$i")
@@ -71,7 +139,7 @@ if [ "$1" == "debug" ]; then
     fi
 
     # Grepping directly does not work so we need to use a temporary file
-    valgrind --leak-check=full --show-leak-kinds=all --track-origins=yes --log-file=$log_file "$takuzu_debug" "$i" &> /dev/null
+    valgrind --leak-check=full --show-leak-kinds=all --track-origins=yes --log-file=$log_file "$takuzu_debug" $i &> /dev/null
     val_res="$(cat $log_file | grep "LEAK SUMMARY" -A5)"
     if [ "$val_res" == "" ]; then
       good_valgrind+=("$i")
@@ -81,7 +149,7 @@ if [ "$1" == "debug" ]; then
   done
 else
   for i in "${normal_test[@]}"; do
-    $takuzu "$i" &> /tmp/takuzu_error
+    $takuzu $i &> /tmp/takuzu_error
     if [ $? -ne 0 ]; then
       echo "- ✗ $i"
       failed_tests+=("$i: $(cat /tmp/takuzu_error)")
@@ -92,7 +160,7 @@ else
   done
 
   for i in "${failure_tests[@]}"; do
-    $takuzu "$i" &> /dev/null
+    $takuzu $i &> /dev/null
     if [ $? -eq 0 ]; then
       echo "- ✗ $i"
       failed_tests+=("$i")
@@ -103,6 +171,26 @@ else
   done
 fi
 
+for i in "${count_tests[@]}"; do
+  args="${i%:*}"
+  expected="${i##*:}"
+  if $takuzu $args 2> /dev/null | grep -qx "Number of solutions: $expected"; then
+    echo "- ✓ $args"
+    success_tests+=("$args")
+  else
+    echo "- ✗ $args"
+    failed_tests+=("$args: not $expected solutions")
+  fi
+done
+
+if [ -x "$api_test" ]; then
+  if "$api_test"; then
+    success_tests+=("api_test")
+  else
+    failed_tests+=("api_test")
+  fi
+fi
+
 echo "Tests passed: ${#success_tests[@]}"
 for i in "${failed_tests[@]}"; do
   echo "Failure: $i"
@@ -113,4 +201,6 @@ if [ "$1" == "debug" ]; then
   for i in "${bad_valgrind[@]}"; do
     echo "- ✗ $i"
   done
-fi
\ No newline at end of file
+fi
+
+[ ${#failed_tests[@]} -eq 0 ]
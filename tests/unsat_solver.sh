@@ -0,0 +1,5 @@
+#!/bin/sh
+# Stands for a SAT solver in the tests: reads the whole formula, like a real
+# solver would, and finds it unsatisfiable
+cat > /dev/null
+echo "s UNSATISFIABLE"